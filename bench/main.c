@@ -0,0 +1,145 @@
+
+#include "easy-yaml.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+/* Get the current time in seconds */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Build a JSON text with an array of records */
+static char* makejson(int records, size_t* len) {
+    char* buff;
+    FILE* strm = open_memstream(&buff, len);
+    assert(strm);
+    fputs("{\"version\": 3, \"records\": [\n", strm);
+    for(int i = 0; i < records; ++i)
+        fprintf(strm, "  {\"id\": %d, \"name\": \"user %d\", \"active\": %s, \"score\": %d.%02d,"
+                      " \"tags\": [\"a\", \"b\\tc\", \"caf\\u00e9\"], \"owner\": null}%s\n",
+                i, i, i % 2 ? "true" : "false", i % 100, i % 97, i + 1 < records ? "," : "");
+    fputs("]}\n", strm);
+    fclose(strm);
+    return buff;
+}
+
+/* Parse a string with LIBYAML */
+static int libyaml(struct eyaml** root, char const* str, size_t len) {
+    FILE* strm = fmemopen((void*)str, len, "r");
+    assert(strm);
+    int err = eyaml_parse(root, strm);
+    fclose(strm);
+    return err;
+}
+
+/* Parse a string with the JSON parser */
+static int json(struct eyaml** root, char const* str, size_t len) {
+    return eyaml_parse_json(root, str, len);
+}
+
+/* Time the parse of a text and return the tree of the last run */
+static double timeparse(int (*parse)(struct eyaml**, char const*, size_t), char const* str, size_t len, int runs, struct eyaml** root) {
+    double best = 1e9;
+    for(int i = 0; i < runs; ++i) {
+        if (i)
+            eyaml_destroy(*root);
+        double const start = now();
+        int err = parse(root, str, len);
+        double const elapsed = now() - start;
+        assert(0 == err);
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+/* Time the emission of a tree to a null stream */
+static double timeemit(int (*emit)(struct eyaml*, FILE*), struct eyaml* root, int runs) {
+    FILE* strm = fopen("/dev/null", "w");
+    assert(strm);
+    double best = 1e9;
+    for(int i = 0; i < runs; ++i) {
+        double const start = now();
+        int err = emit(root, strm);
+        fflush(strm);
+        double const elapsed = now() - start;
+        assert(0 == err);
+        if (elapsed < best)
+            best = elapsed;
+    }
+    fclose(strm);
+    return best;
+}
+
+/* Small messages: the first ones take the JSON and native paths, the
+   last one needs LIBYAML because of its tags */
+static char const* const messages[] = {
+    "{\"id\": 17, \"op\": \"update\", \"fields\": {\"name\": \"user 17\", \"score\": 3.5}}",
+    "id: 17\nop: update\nfields:\n  name: user 17\n  score: 3.5\n  tags: [a, b]\n",
+    "%TAG !m! tag:example.com,2024:\n--- !m!msg\nid: !!int 17\nop: update\nfields:\n  name: 'user 17'\n  score: 3.5\n"
+};
+
+/* Time the parse of a message many times, with a parser context if not null.
+   Return the best time per message */
+static double timemessage(char const* msg, int count, int runs, struct eyamlparser* parser) {
+    size_t const len = strlen(msg);
+    double best = 1e9;
+    for(int run = 0; run < runs; ++run) {
+        double const start = now();
+        for(int i = 0; i < count; ++i) {
+            struct eyaml* root;
+            int err = parser ? eyaml_parser_parse(parser, &root, msg, len)
+                             : eyaml_parse_string(&root, msg, len);
+            assert(0 == err);
+            if (NULL == parser)
+                eyaml_destroy(root);
+        }
+        double const elapsed = (now() - start) / count;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int const records = argc > 1 ? atoi(argv[1]) : 2000;
+    int const runs = argc > 2 ? atoi(argv[2]) : 5;
+    size_t len;
+    char* str = makejson(records, &len);
+    printf("%d records, %zu bytes, best of %d runs\n\n", records, len, runs);
+
+    struct eyaml* slow = NULL;
+    struct eyaml* fast = NULL;
+    double const tyaml = timeparse(libyaml, str, len, runs, &slow);
+    double const tjson = timeparse(json, str, len, runs, &fast);
+    printf("parse  libyaml: %9.3f ms %8.1f MB/s\n", tyaml * 1e3, len / tyaml / 1e6);
+    printf("parse  json:    %9.3f ms %8.1f MB/s  x%.1f\n", tjson * 1e3, len / tjson / 1e6, tyaml / tjson);
+
+    double const eyaml = timeemit(eyaml_emit, fast, runs);
+    double const ejson = timeemit(eyaml_emit_json, fast, runs);
+    printf("emit   yaml:    %9.3f ms\n", eyaml * 1e3);
+    printf("emit   json:    %9.3f ms            x%.1f\n", ejson * 1e3, eyaml / ejson);
+
+    eyaml_destroy(slow);
+    eyaml_destroy(fast);
+    free(str);
+
+    int const count = 10 * records;
+    printf("\n%d small messages, best of %d runs\n\n", count, runs);
+    struct eyamlparser* parser = eyaml_parser_create(NULL);
+    assert(parser);
+    char const* const paths[] = { "json", "native", "libyaml" };
+    for(int i = 0; i < sizeof messages / sizeof *messages; ++i) {
+        double const cold = timemessage(messages[i], count, runs, NULL);
+        double const warm = timemessage(messages[i], count, runs, parser);
+        printf("%-8s %3zu bytes: string %7.0f ns  context %7.0f ns  x%.2f\n", paths[i], strlen(messages[i]),
+               cold * 1e9, warm * 1e9, cold / warm);
+    }
+    eyaml_parser_destroy(parser);
+    return 0;
+}
@@ -3,7 +3,29 @@
 #include "easy-yaml.h"
 #include <yaml.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef EYAML_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef EYAML_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define arraylen(arr) (sizeof (arr) / sizeof *(arr))
 
@@ -13,6 +35,7 @@
 /* Hold a linked stack of pointers */
 struct stack {
     struct item* top;
+    struct item* spare; /* Popped items to be pushed again */
 };
 
 /* Node for the linked stack of pointers */
@@ -24,6 +47,7 @@ struct item {
 /* Initialize a stack */
 static void stack_init(struct stack* self) {
     self->top = NULL;
+    self->spare = NULL;
 }
 
 /* Check if the stack is empty */
@@ -31,12 +55,17 @@ static int stack_isempty(struct stack const* self) {
     return NULL == self->top;
 }
 
-/* Push a pointer on the stack */
-static void stack_push(struct stack* self, void* data) {
-    struct item* item = malloc(sizeof *item);
+/* Push a pointer on the stack, return non-zero on error */
+static int stack_push(struct stack* self, void* data) {
+    struct item* item = self->spare;
+    if (NULL != item)
+        self->spare = item->down;
+    else if (NULL == (item = malloc(sizeof *item)))
+        return -1;
     item->data = data;
     item->down = self->top;
     self->top  = item;
+    return 0;
 }
 
 /* Pop a pointer, return null on empty */
@@ -45,9 +74,9 @@ static void* stack_pop(struct stack* self) {
         return NULL;
     struct item* item = self->top;
     self->top = self->top->down;
-    void* data = item->data;
-    free(item);
-    return data;
+    item->down = self->spare;
+    self->spare = item;
+    return item->data;
 }
 
 /* Get the top pointer without remove it */
@@ -57,12 +86,22 @@ void* stack_pick(struct stack const* self) {
     return self->top->data;
 }
 
-/* Remove al pointers */
-void stack_flush(struct stack* self) {
+/* Remove all pointers, keeping their items as spare ones */
+static void stack_clear(struct stack* self) {
     while(!stack_isempty(self))
         stack_pop(self);
 }
 
+/* Remove all pointers and release the memory of the stack */
+void stack_flush(struct stack* self) {
+    stack_clear(self);
+    while (NULL != self->spare) {
+        struct item* item = self->spare;
+        self->spare = item->down;
+        free(item);
+    }
+}
+
 /* --------------------------------------------------------------------- */
 /* --------------------------------------------------------------------- */
 
@@ -73,43 +112,254 @@ struct eyaml {
     yaml_event_t events[3];
 };
 
-/* Create an empty easy-yaml node */
-static struct eyaml* eyaml_create(void) {
-    struct eyaml* node = malloc(sizeof *node);
-    if (NULL == node)
+/* Chunk of the nodes of a tree. The root of a tree is the first node of its
+   first chunk, so a whole tree is released sweeping its chunks in order */
+struct chunk {
+    struct chunk* next;
+    int used;
+    int size;
+    int packed; /* The strings of the events are in the chunk too */
+    struct eyaml nodes[];
+};
+
+/* Number of nodes of the first chunk of a tree, the next ones double it */
+#define CHUNK_MINSIZE 16
+
+/* Maximum number of nodes of a chunk */
+#define CHUNK_MAXSIZE 4096
+
+/* Memory kept between the parses of a parser context */
+struct pool {
+    struct chunk* chunks; /* Free chunks of nodes */
+    struct item* items;   /* Free items of the stack of the LIBYAML parse */
+};
+
+/* Allocator of the nodes of a tree being built */
+struct tree {
+    struct chunk* first;
+    struct chunk* last;
+    struct pool* pool;       /* Where to take chunks from, may be null */
+    struct eyamlopts limits; /* Zero fields for no limit */
+    size_t nodes;            /* Number of nodes allocated */
+    int docs;                /* Number of documents started */
+    int err;                 /* Why the last allocation failed */
+};
+
+/* Initialize a tree with the limits of some options, null for none */
+static void tree_init(struct tree* self, struct eyamlopts const* opts) {
+    memset(self, 0, sizeof *self);
+    if (NULL != opts)
+        self->limits = *opts;
+}
+
+/* Check if a value is beyond a limit, zero means no limit */
+static int overlimit(size_t value, size_t limit) {
+    return 0 != limit && value > limit;
+}
+
+/* Create an empty easy-yaml node. The first one is the root of the tree */
+static struct eyaml* tree_node(struct tree* self) {
+    if (overlimit(self->nodes + 1, self->limits.maxnodes)) {
+        self->err = EYAML_ENODES;
         return NULL;
+    }
+    struct chunk* chunk = self->last;
+    if (NULL == chunk || chunk->used == chunk->size) {
+        int const size = NULL == chunk ? CHUNK_MINSIZE
+                       : chunk->size < CHUNK_MAXSIZE ? 2 * chunk->size : CHUNK_MAXSIZE;
+        if (NULL != self->pool && NULL != self->pool->chunks) {
+            chunk = self->pool->chunks;
+            self->pool->chunks = chunk->next;
+        }
+        else if (NULL != (chunk = malloc(sizeof *chunk + size * sizeof *chunk->nodes)))
+            chunk->size = size;
+        else {
+            self->err = -1;
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->used = 0;
+        chunk->packed = 0;
+        if (NULL == self->last)
+            self->first = chunk;
+        else
+            self->last->next = chunk;
+        self->last = chunk;
+    }
+    struct eyaml* node = chunk->nodes + chunk->used++;
     memset(node, 0, sizeof *node);
+    ++self->nodes;
     return node;
 }
 
+/* Check the nesting of a new collection against the limits */
+static int tree_depth(struct tree const* self, int depth) {
+    return overlimit(depth, self->limits.maxdepth) ? EYAML_EDEPTH : 0;
+}
+
+/* Check the length of a new scalar against the limits */
+static int tree_scalar(struct tree const* self, size_t len) {
+    return overlimit(len, self->limits.maxscalar) ? EYAML_ESCALAR : 0;
+}
+
+/* Count a new document and check it against the limits */
+static int tree_document(struct tree* self) {
+    return overlimit(++self->docs, self->limits.maxdocs) ? EYAML_EDOCS : 0;
+}
+
+/* Release a list of chunks and the events of their nodes */
+static void chunks_free(struct chunk* chunk) {
+    while (NULL != chunk) {
+        struct chunk* next = chunk->next;
+        for(int i = 0; !chunk->packed && i < chunk->used; ++i)
+            for(int j = 0; j < arraylen(chunk->nodes[i].events); ++j)
+                yaml_event_delete(chunk->nodes[i].events + j);
+        free(chunk);
+        chunk = next;
+    }
+}
+
+/* Delete the events of a list of chunks and give them to a pool */
+static void chunks_recycle(struct chunk* chunk, struct pool* pool) {
+    while (NULL != chunk) {
+        struct chunk* next = chunk->next;
+        for(int i = 0; i < chunk->used; ++i)
+            for(int j = 0; j < arraylen(chunk->nodes[i].events); ++j)
+                yaml_event_delete(chunk->nodes[i].events + j);
+        chunk->used = 0;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        chunk = next;
+    }
+}
+
+/* Release all the nodes of a tree being built */
+static void tree_free(struct tree* self) {
+    if (NULL != self->pool)
+        chunks_recycle(self->first, self->pool);
+    else
+        chunks_free(self->first);
+    self->first = NULL;
+    self->last = NULL;
+    self->nodes = 0;
+}
+
+/* Move all the nodes of a built tree into a tree. Its root stays as an
+   unused node that is released with the rest */
+static void tree_adopt(struct tree* self, struct eyaml* root) {
+    struct chunk* chunk = (struct chunk*)((char*)root - offsetof(struct chunk, nodes));
+    if (NULL == self->last)
+        self->first = chunk;
+    else
+        self->last->next = chunk;
+    for(;;) {
+        self->nodes += chunk->used;
+        if (NULL == chunk->next)
+            break;
+        chunk = chunk->next;
+    }
+    self->last = chunk;
+}
+
 /* Free a tree of easy-yaml nodes */
 void eyaml_destroy(struct eyaml* self)  {
     if (NULL == self)
         return;
-    struct stack garbage;
-    stack_init(&garbage);
-    stack_push(&garbage, self);
-    do {
-        struct eyaml* node = stack_pop(&garbage);
-        if (NULL != node->sibling)
-            stack_push(&garbage, node->sibling);
-        if (NULL != node->child)
-            stack_push(&garbage, node->child);
-        for(int i = 0; i < arraylen(self->events); ++i)
-            yaml_event_delete(self->events + i);
-        free(node);
-    } while(!stack_isempty(&garbage));
-}
-
-static void eyaml_appned(struct eyaml* self, struct eyaml* child) {
+    chunks_free((struct chunk*)((char*)self - offsetof(struct chunk, nodes)));
+}
+
+/* --------------------------------------------------------------------- */
+/* ----------------------- Background reclaimer ------------------------ */
+/* --------------------------------------------------------------------- */
+
+/* The reclaimer frees the trees given to eyaml_destroy_async() in a
+   background thread. The trees are queued by linking their roots through
+   the unused 'sibling' field, so queuing a tree does not allocate and
+   costs the same for any size. The thread frees one chunk at a time, at
+   most CHUNK_MAXSIZE nodes, and exits when the queue is empty. */
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;   /* Signaled when the thread exits              */
+    struct eyaml* first;   /* Queue of trees linked through their sibling */
+    struct eyaml* last;
+    int running;           /* A thread is freeing the queue               */
+} reclaimer = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0 };
+
+/* Free the queued trees until there are none */
+static void* reclaimer_run(void* arg) {
+    pthread_mutex_lock(&reclaimer.lock);
+    while (NULL != reclaimer.first) {
+        struct eyaml* root = reclaimer.first;
+        reclaimer.first = root->sibling;
+        if (NULL == reclaimer.first)
+            reclaimer.last = NULL;
+        pthread_mutex_unlock(&reclaimer.lock);
+        struct chunk* chunk = (struct chunk*)((char*)root - offsetof(struct chunk, nodes));
+        while (NULL != chunk) {
+            struct chunk* next = chunk->next;
+            chunk->next = NULL;
+            chunks_free(chunk);
+            chunk = next;
+        }
+        pthread_mutex_lock(&reclaimer.lock);
+    }
+    reclaimer.running = 0;
+    pthread_cond_broadcast(&reclaimer.idle);
+    pthread_mutex_unlock(&reclaimer.lock);
+    return NULL;
+}
+
+/* Queue a tree to be freed in the background */
+void eyaml_destroy_async(struct eyaml* self) {
+    if (NULL == self)
+        return;
+    self->sibling = NULL;
+    pthread_mutex_lock(&reclaimer.lock);
+    if (NULL == reclaimer.last)
+        reclaimer.first = self;
+    else
+        reclaimer.last->sibling = self;
+    reclaimer.last = self;
+    if (!reclaimer.running) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        reclaimer.running = 0 == pthread_create(&thread, &attr, reclaimer_run, NULL);
+        pthread_attr_destroy(&attr);
+    }
+    if (reclaimer.running) {
+        pthread_mutex_unlock(&reclaimer.lock);
+        return;
+    }
+    /* No thread could be started: free the queue in this one */
+    struct eyaml* root = reclaimer.first;
+    reclaimer.first = NULL;
+    reclaimer.last = NULL;
+    pthread_mutex_unlock(&reclaimer.lock);
+    while (NULL != root) {
+        struct eyaml* next = root->sibling;
+        eyaml_destroy(root);
+        root = next;
+    }
+}
+
+/* Wait until every tree given to eyaml_destroy_async() is freed */
+void eyaml_destroy_drain(void) {
+    pthread_mutex_lock(&reclaimer.lock);
+    while (reclaimer.running)
+        pthread_cond_wait(&reclaimer.idle, &reclaimer.lock);
+    pthread_mutex_unlock(&reclaimer.lock);
+}
+
+/* Append a child to a node. 'last' is its last child, null if it has none */
+static void eyaml_appned(struct eyaml* self, struct eyaml* last, struct eyaml* child) {
     child->child = NULL;
-    if ( self->child == NULL )
+    if (NULL == last)
         self->child = child;
-    else {
-        struct eyaml* iter;
-        for( iter = self->child; NULL != iter->sibling; iter = iter->sibling );
-        iter->sibling = child;
-    }
+    else
+        last->sibling = child;
 }
 
 static int istype(struct eyaml const* node, yaml_event_type_t a, yaml_event_type_t b, yaml_event_type_t c ) {
@@ -136,6 +386,8 @@ enum eyamltype eyaml_type(struct eyaml* self) {
 
 /* Search in a mapping member node by its name */
 struct eyaml* eyaml_name2child(struct eyaml* self, char const* name) {
+    if (NULL == self)
+        return NULL;
     int isdoc = istype(self, YAML_DOCUMENT_START_EVENT, YAML_DOCUMENT_END_EVENT, YAML_NO_EVENT);
     if (isdoc)
         self = self->child;
@@ -149,6 +401,8 @@ struct eyaml* eyaml_name2child(struct eyaml* self, char const* name) {
 
 /* Search in a mapping or sequence member node by its index */
 struct eyaml* eyaml_index2child(struct eyaml* self, int index) {
+    if (NULL == self || index < 0)
+        return NULL;
     if ( istype(self, YAML_SCALAR_EVENT, YAML_SCALAR_EVENT, YAML_NO_EVENT) ||
          istype(self, YAML_SCALAR_EVENT, YAML_NO_EVENT, YAML_NO_EVENT) )
         return NULL;
@@ -156,13 +410,8 @@ struct eyaml* eyaml_index2child(struct eyaml* self, int index) {
     if (isdoc)
         self = self->child;
     struct eyaml* child = self->child;
-    for(int i = 0; i < index; ++i)
+    for(int i = 0; i < index && NULL != child; ++i)
         child = child->sibling;
-    if (NULL == child)
-        return NULL;
-    isdoc = istype(child, YAML_DOCUMENT_START_EVENT, YAML_DOCUMENT_END_EVENT, YAML_NO_EVENT);
-    if (isdoc)
-        child = self->child;
     return child;
 }
 
@@ -202,6 +451,8 @@ char const* eyaml_name(struct eyaml* self) {
 
 /* Get the value of a scalar node */
 char const* eyaml_value(struct eyaml* self) {
+    if (NULL == self)
+        return NULL;
     int isdoc = istype(self, YAML_DOCUMENT_START_EVENT, YAML_DOCUMENT_END_EVENT, YAML_NO_EVENT);
     if (isdoc)
         self = self->child;
@@ -237,6 +488,298 @@ int eyaml_values(struct eyaml* self, void* dest, char const* names[] ) {
     return cnt;
 }
 
+/* --------------------------------------------------------------------- */
+/* ---------------------------- Value index ---------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* Element of a collection indexed by the value of one of its fields */
+struct entry {
+    struct eyaml* node; /* The element */
+    char const* value;  /* Value of the field */
+    int len;            /* Length of the value */
+    int next;           /* Next entry with the same value, -1 if none */
+    uint64_t hash;
+};
+
+/* Holds an index. It is an open addressing hash table whose slots hold the
+   first entry of each value, -1 if free. Entries of the same value are
+   linked in document order */
+struct eyamlindex {
+    int count;        /* Number of entries */
+    int values;       /* Number of different values */
+    unsigned mask;    /* Number of slots minus one */
+    int* slots;
+    struct entry entries[];
+};
+
+/* FNV-1a hash of a string */
+static uint64_t hash(char const* str, int len) {
+    uint64_t h = 14695981039346656037u;
+    for(int i = 0; i < len; ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211u;
+    }
+    return h;
+}
+
+/* Find the slot of a value, it is free if the value is not in the index */
+static int* index_slot(struct eyamlindex const* self, char const* value, int len, uint64_t h) {
+    for(unsigned i = h & self->mask;; i = (i + 1) & self->mask) {
+        int* slot = self->slots + i;
+        if (-1 == *slot)
+            return slot;
+        struct entry const* entry = self->entries + *slot;
+        if (h == entry->hash && len == entry->len && 0 == memcmp(value, entry->value, len))
+            return slot;
+    }
+}
+
+/* Build an index of the elements of a collection by the value of a field */
+struct eyamlindex* eyaml_build_index(struct eyaml* self, char const* name) {
+    if (NULL == self || EYAML_SCALAR == eyaml_type(self))
+        return NULL;
+    int count = 0;
+    for(struct eyaml* i = eyaml_child(self); NULL != i; i = i->sibling)
+        if (NULL != eyaml_name2value(i, name))
+            ++count;
+    unsigned size = 8;
+    while (size < 2u * count)
+        size *= 2;
+    struct eyamlindex* index = malloc(sizeof *index + count * sizeof *index->entries + size * sizeof(int));
+    if (NULL == index)
+        return NULL;
+    index->count = count;
+    index->values = 0;
+    index->mask = size - 1;
+    index->slots = (int*)(index->entries + count);
+    memset(index->slots, -1, size * sizeof(int));
+    int* lasts = malloc((count ? count : 1) * sizeof *lasts); /* Last entry of each chain */
+    if (NULL == lasts) {
+        free(index);
+        return NULL;
+    }
+    int n = 0;
+    for(struct eyaml* i = eyaml_child(self); NULL != i; i = i->sibling) {
+        struct eyaml* field = eyaml_name2child(i, name);
+        char const* value = NULL == field ? NULL : eyaml_value(field);
+        if (NULL == value)
+            continue;
+        struct entry* entry = index->entries + n;
+        entry->node = i;
+        entry->value = value;
+        entry->len = eyaml_length(field);
+        entry->next = -1;
+        entry->hash = hash(value, entry->len);
+        int* slot = index_slot(index, value, entry->len, entry->hash);
+        if (-1 == *slot) {
+            *slot = n;
+            lasts[n] = n;
+            ++index->values;
+        }
+        else {
+            int* last = lasts + *slot;
+            index->entries[*last].next = n;
+            *last = n;
+        }
+        ++n;
+    }
+    free(lasts);
+    return index;
+}
+
+/* Find the first element whose field has a value */
+struct eyaml* eyaml_index_find(struct eyamlindex const* self, char const* value) {
+    if (NULL == self || NULL == value)
+        return NULL;
+    int const len = strlen(value);
+    int const* slot = index_slot(self, value, len, hash(value, len));
+    return -1 == *slot ? NULL : self->entries[*slot].node;
+}
+
+/* Get all the elements whose field has a value */
+int eyaml_index_findall(struct eyamlindex const* self, char const* value, struct eyaml** dest, int max) {
+    if (NULL == self || NULL == value)
+        return 0;
+    int const len = strlen(value);
+    int const* slot = index_slot(self, value, len, hash(value, len));
+    int cnt = 0;
+    for(int i = *slot; -1 != i; i = self->entries[i].next) {
+        if (cnt < max)
+            dest[cnt] = self->entries[i].node;
+        ++cnt;
+    }
+    return cnt;
+}
+
+/* Check if every element of an index has a different value */
+int eyaml_index_isunique(struct eyamlindex const* self) {
+    return NULL != self && self->count == self->values;
+}
+
+/* Free an index */
+void eyaml_index_free(struct eyamlindex* self) {
+    free(self);
+}
+
+/* --------------------------------------------------------------------- */
+/* ---------------------------- Extraction ----------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* An extracted tree is a single packed chunk: the nodes in depth-first
+   order followed by the strings and directives of their events. */
+
+/* Round a size to keep the alignment of the packed data */
+static size_t packsize(size_t size) {
+    size_t const align = sizeof(void*);
+    return (size + align - 1) / align * align;
+}
+
+/* Copy a string into the packed data, only measure it if 'buff' is null */
+static yaml_char_t* packstr(yaml_char_t const* str, char** buff, size_t* size) {
+    if (NULL == str)
+        return NULL;
+    size_t const len = strlen((char const*)str) + 1;
+    *size += packsize(len);
+    if (NULL == *buff)
+        return NULL;
+    yaml_char_t* dest = memcpy(*buff, str, len);
+    *buff += packsize(len);
+    return dest;
+}
+
+/* Copy an event moving its data into the packed data. Only measure the
+   size of its data if 'buff' is null */
+static size_t packevent(yaml_event_t* dest, yaml_event_t const* src, char* buff) {
+    size_t size = 0;
+    yaml_event_t event = *src;
+    switch(src->type) {
+        case YAML_DOCUMENT_START_EVENT: {
+            yaml_version_directive_t const* version = src->data.document_start.version_directive;
+            if (NULL != version) {
+                size += packsize(sizeof *version);
+                if (NULL != buff) {
+                    event.data.document_start.version_directive = memcpy(buff, version, sizeof *version);
+                    buff += packsize(sizeof *version);
+                }
+            }
+            yaml_tag_directive_t const* start = src->data.document_start.tag_directives.start;
+            yaml_tag_directive_t const* end = src->data.document_start.tag_directives.end;
+            size_t const len = (end - start) * sizeof *start;
+            yaml_tag_directive_t* tags = NULL;
+            if (0 != len) {
+                size += packsize(len);
+                if (NULL != buff) {
+                    tags = (yaml_tag_directive_t*)buff;
+                    buff += packsize(len);
+                }
+            }
+            for(yaml_tag_directive_t const* i = start; i < end; ++i) {
+                yaml_char_t* handle = packstr(i->handle, &buff, &size);
+                yaml_char_t* prefix = packstr(i->prefix, &buff, &size);
+                if (NULL != tags) {
+                    tags[i - start].handle = handle;
+                    tags[i - start].prefix = prefix;
+                }
+            }
+            event.data.document_start.tag_directives.start = tags;
+            event.data.document_start.tag_directives.end = NULL == tags ? NULL : tags + (end - start);
+            break;
+        }
+        case YAML_ALIAS_EVENT:
+            event.data.alias.anchor = packstr(src->data.alias.anchor, &buff, &size);
+            break;
+        case YAML_SCALAR_EVENT:
+            event.data.scalar.anchor = packstr(src->data.scalar.anchor, &buff, &size);
+            event.data.scalar.tag = packstr(src->data.scalar.tag, &buff, &size);
+            /* The value may hold null characters */
+            size += packsize(src->data.scalar.length + 1);
+            if (NULL != buff) {
+                event.data.scalar.value = memcpy(buff, src->data.scalar.value, src->data.scalar.length + 1);
+                buff += packsize(src->data.scalar.length + 1);
+            }
+            break;
+        case YAML_SEQUENCE_START_EVENT:
+            event.data.sequence_start.anchor = packstr(src->data.sequence_start.anchor, &buff, &size);
+            event.data.sequence_start.tag = packstr(src->data.sequence_start.tag, &buff, &size);
+            break;
+        case YAML_MAPPING_START_EVENT:
+            event.data.mapping_start.anchor = packstr(src->data.mapping_start.anchor, &buff, &size);
+            event.data.mapping_start.tag = packstr(src->data.mapping_start.tag, &buff, &size);
+            break;
+        default:
+            break;
+    }
+    if (NULL != dest)
+        *dest = event;
+    return size;
+}
+
+/* Copy a subtree into a new standalone tree */
+struct eyaml* eyaml_extract(struct eyaml* self) {
+    if (NULL == self)
+        return NULL;
+
+    /* Measure the subtree */
+    int count = 0;
+    size_t size = 0;
+    struct stack nodes;
+    stack_init(&nodes);
+    if (stack_push(&nodes, self))
+        return NULL;
+    while (!stack_isempty(&nodes)) {
+        struct eyaml* node = stack_pop(&nodes);
+        ++count;
+        for(int i = 0; i < arraylen(node->events); ++i)
+            size += packevent(NULL, node->events + i, NULL);
+        if ((node != self && NULL != node->sibling && stack_push(&nodes, node->sibling)) ||
+            (NULL != node->child && stack_push(&nodes, node->child))) {
+            stack_flush(&nodes);
+            return NULL;
+        }
+    }
+
+    struct chunk* chunk = malloc(sizeof *chunk + count * sizeof *chunk->nodes + size);
+    if (NULL == chunk)
+        return NULL;
+    chunk->next = NULL;
+    chunk->used = count;
+    chunk->size = count;
+    chunk->packed = 1;
+    char* buff = (char*)(chunk->nodes + count);
+
+    /* Copy it in depth-first order. The stack holds each source node
+       over the link of the copy that has to point to its copy */
+    struct eyaml* root = NULL;
+    if (stack_push(&nodes, &root) || stack_push(&nodes, self)) {
+        stack_flush(&nodes);
+        free(chunk);
+        return NULL;
+    }
+    int n = 0;
+    while (!stack_isempty(&nodes)) {
+        struct eyaml* node = stack_pop(&nodes);
+        struct eyaml** link = stack_pop(&nodes);
+        struct eyaml* copy = chunk->nodes + n++;
+        *link = copy;
+        copy->sibling = NULL;
+        copy->child = NULL;
+        for(int i = 0; i < arraylen(node->events); ++i)
+            buff += packevent(copy->events + i, node->events + i, buff);
+        int err = 0;
+        if (node != self && NULL != node->sibling)
+            err = stack_push(&nodes, &copy->sibling) || stack_push(&nodes, node->sibling);
+        if (!err && NULL != node->child)
+            err = stack_push(&nodes, &copy->child) || stack_push(&nodes, node->child);
+        if (err) {
+            stack_flush(&nodes);
+            free(chunk);
+            return NULL;
+        }
+    }
+    stack_flush(&nodes);
+    return root;
+}
+
 
 static int isclosing(yaml_event_type_t event) {
     return
@@ -246,13 +789,75 @@ static int isclosing(yaml_event_type_t event) {
         YAML_MAPPING_END_EVENT   == event;
 }
 
+/* Emit a copy of an event, the emitter frees the events it gets */
+static int emitevent(yaml_emitter_t* emitter, yaml_event_t const* event) {
+    yaml_event_t copy;
+    int ok;
+    switch(event->type) {
+        case YAML_STREAM_START_EVENT:
+            ok = yaml_stream_start_event_initialize(&copy, event->data.stream_start.encoding);
+            break;
+        case YAML_STREAM_END_EVENT:
+            ok = yaml_stream_end_event_initialize(&copy);
+            break;
+        case YAML_DOCUMENT_START_EVENT:
+            ok = yaml_document_start_event_initialize(&copy,
+                event->data.document_start.version_directive,
+                event->data.document_start.tag_directives.start,
+                event->data.document_start.tag_directives.end,
+                event->data.document_start.implicit);
+            break;
+        case YAML_DOCUMENT_END_EVENT:
+            ok = yaml_document_end_event_initialize(&copy, event->data.document_end.implicit);
+            break;
+        case YAML_ALIAS_EVENT:
+            ok = yaml_alias_event_initialize(&copy, event->data.alias.anchor);
+            break;
+        case YAML_SCALAR_EVENT:
+            ok = yaml_scalar_event_initialize(&copy,
+                event->data.scalar.anchor,
+                event->data.scalar.tag,
+                event->data.scalar.value,
+                event->data.scalar.length,
+                event->data.scalar.plain_implicit,
+                event->data.scalar.quoted_implicit,
+                event->data.scalar.style);
+            break;
+        case YAML_SEQUENCE_START_EVENT:
+            ok = yaml_sequence_start_event_initialize(&copy,
+                event->data.sequence_start.anchor,
+                event->data.sequence_start.tag,
+                event->data.sequence_start.implicit,
+                event->data.sequence_start.style);
+            break;
+        case YAML_SEQUENCE_END_EVENT:
+            ok = yaml_sequence_end_event_initialize(&copy);
+            break;
+        case YAML_MAPPING_START_EVENT:
+            ok = yaml_mapping_start_event_initialize(&copy,
+                event->data.mapping_start.anchor,
+                event->data.mapping_start.tag,
+                event->data.mapping_start.implicit,
+                event->data.mapping_start.style);
+            break;
+        case YAML_MAPPING_END_EVENT:
+            ok = yaml_mapping_end_event_initialize(&copy);
+            break;
+        default:
+            return -1;
+    }
+    if (!ok || !yaml_emitter_emit(emitter, &copy))
+        return -1;
+    return 0;
+}
+
 static int emitNotClosingEvents(struct eyaml* self, yaml_emitter_t* emitter) {
     for(int i = 0; i < arraylen(self->events); ++i) {
         yaml_event_type_t type = self->events[i].type;
         if (YAML_NO_EVENT == type)
             return 0;
         if (!isclosing(type))
-            if (!yaml_emitter_emit(emitter, self->events + i))
+            if (emitevent(emitter, self->events + i))
                 return -1;
     }
     return 0;
@@ -264,7 +869,7 @@ static int emitClosingEvents(struct eyaml* self, yaml_emitter_t* emitter) {
         if (YAML_NO_EVENT == type)
             return 0;
         if (isclosing(type))
-            if (!yaml_emitter_emit(emitter, self->events + i))
+            if (emitevent(emitter, self->events + i))
                 return -1;
     }
     return 0;
@@ -327,13 +932,301 @@ int eyaml_emit(struct eyaml* self, FILE* strm) {
 
 
     /* success: */
+    stack_flush(&nodes);
+    yaml_emitter_delete(&emitter);
     return 0;
 
   error:
     stack_flush(&nodes);
+    yaml_emitter_delete(&emitter);
     return -1;
 }
 
+/* --------------------------------------------------------------------- */
+/* ------------------------- Streaming writer -------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* The writer streams events to the LIBYAML emitter as they are called,
+   so its memory does not depend on the size of the output: the emitter
+   looks ahead at most three events and the writer keeps one context byte
+   per open collection. The emitted text goes through a buffer that is
+   flushed to the sink in batches of the configured size.
+   A sequence is held back while it has at most 'flowseq' scalar items:
+   if it ends before getting more items or a collection it is emitted in
+   flow style, otherwise its pending items are emitted in block style. */
+
+/* Context of an open collection */
+enum {
+    WRITER_KEY   = 'k', /* A mapping that expects a key             */
+    WRITER_VALUE = 'v', /* A mapping that expects the value of a key */
+    WRITER_SEQ   = 's'  /* A sequence                               */
+};
+
+struct eyamlwriter {
+    yaml_emitter_t emitter;
+    eyamlsink sink;
+    void* data;
+    int fd;
+    char* buff;         /* Output batch                                     */
+    size_t len;         /* Bytes in the batch                               */
+    size_t size;        /* Capacity of the batch                            */
+    char* ctx;          /* Context of each open collection                  */
+    int depth;          /* Number of open collections                       */
+    int capacity;       /* Capacity of the context array                    */
+    int flowseq;        /* Maximum number of items of a flow sequence       */
+    int pending;        /* Held back items, -1 if no sequence is held back  */
+    int err;            /* The first error, every call fails after it       */
+    yaml_event_t items[];
+};
+
+/* Write bytes to a file descriptor */
+static int fdsink(void* data, char const* buff, size_t len) {
+    int const fd = *(int const*)data;
+    while (len) {
+        ssize_t const written = write(fd, buff, len);
+        if (written < 0 && EINTR == errno)
+            continue;
+        if (written <= 0)
+            return -1;
+        buff += written;
+        len -= written;
+    }
+    return 0;
+}
+
+/* Send the output batch to the sink */
+static int writer_drain(struct eyamlwriter* self) {
+    if (0 == self->len)
+        return 0;
+    int const err = self->sink(self->data, self->buff, self->len);
+    self->len = 0;
+    return err;
+}
+
+/* Output handler of the LIBYAML emitter */
+static int writer_output(void* data, unsigned char* buff, size_t size) {
+    struct eyamlwriter* self = data;
+    if (self->len + size > self->size && writer_drain(self))
+        return 0;
+    if (size > self->size)
+        return 0 == self->sink(self->data, (char const*)buff, size);
+    memcpy(self->buff + self->len, buff, size);
+    self->len += size;
+    return 1;
+}
+
+/* Send an initialized event to the emitter, it takes its ownership */
+static int writer_emit(struct eyamlwriter* self, yaml_event_t* event) {
+    if (!yaml_emitter_emit(&self->emitter, event))
+        self->err = -1;
+    return self->err;
+}
+
+/* Emit the held back sequence in flow or block style */
+static int writer_release(struct eyamlwriter* self, yaml_sequence_style_t style) {
+    int const count = self->pending;
+    self->pending = -1;
+    yaml_event_t event;
+    if (!yaml_sequence_start_event_initialize(&event, NULL, NULL, 1, style)) {
+        for(int i = 0; i < count; ++i)
+            yaml_event_delete(self->items + i);
+        return self->err = -1;
+    }
+    int err = writer_emit(self, &event);
+    for(int i = 0; i < count; ++i) {
+        if (err)
+            yaml_event_delete(self->items + i);
+        else
+            err = writer_emit(self, self->items + i);
+    }
+    return err;
+}
+
+/* Check that a node can be written here and open a document if needed */
+static int writer_node(struct eyamlwriter* self) {
+    if (self->err)
+        return self->err;
+    if (0 == self->depth) {
+        yaml_event_t event;
+        if (!yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1))
+            return self->err = -1;
+        return writer_emit(self, &event);
+    }
+    char* const top = self->ctx + self->depth - 1;
+    if (WRITER_KEY == *top)
+        return self->err = -1;
+    if (WRITER_VALUE == *top)
+        *top = WRITER_KEY;
+    return 0;
+}
+
+/* Open a collection */
+static int writer_begin(struct eyamlwriter* self, char ctx) {
+    if (0 <= self->pending && writer_release(self, YAML_BLOCK_SEQUENCE_STYLE))
+        return self->err;
+    if (writer_node(self))
+        return self->err;
+    if (self->depth == self->capacity) {
+        int const capacity = self->capacity ? 2 * self->capacity : 16;
+        char* const ctxs = realloc(self->ctx, capacity);
+        if (NULL == ctxs)
+            return self->err = -1;
+        self->ctx = ctxs;
+        self->capacity = capacity;
+    }
+    self->ctx[self->depth++] = ctx;
+    if (WRITER_SEQ == ctx && 0 < self->flowseq) {
+        self->pending = 0;
+        return 0;
+    }
+    yaml_event_t event;
+    int ok = WRITER_SEQ == ctx
+        ? yaml_sequence_start_event_initialize(&event, NULL, NULL, 1, YAML_BLOCK_SEQUENCE_STYLE)
+        : yaml_mapping_start_event_initialize(&event, NULL, NULL, 1, YAML_BLOCK_MAPPING_STYLE);
+    if (!ok)
+        return self->err = -1;
+    return writer_emit(self, &event);
+}
+
+/* Create a writer, the file descriptor is used if the sink is fdsink() */
+static struct eyamlwriter* writer_create(eyamlsink sink, void* data, int fd, struct eyamlwriteropts const* opts) {
+    int const flowseq = opts && 0 < opts->flowseq ? opts->flowseq : 0;
+    size_t const size = opts && opts->buffsize ? opts->buffsize : 64 * 1024;
+    struct eyamlwriter* self = malloc(sizeof *self + flowseq * sizeof (yaml_event_t));
+    if (NULL == self)
+        return NULL;
+    self->buff = malloc(size);
+    if (NULL == self->buff || !yaml_emitter_initialize(&self->emitter)) {
+        free(self->buff);
+        free(self);
+        return NULL;
+    }
+    self->sink = sink;
+    self->fd = fd;
+    self->data = fdsink == sink ? &self->fd : data;
+    self->len = 0;
+    self->size = size;
+    self->ctx = NULL;
+    self->depth = 0;
+    self->capacity = 0;
+    self->flowseq = flowseq;
+    self->pending = -1;
+    self->err = 0;
+    yaml_emitter_set_output(&self->emitter, writer_output, self);
+    yaml_emitter_set_unicode(&self->emitter, 1);
+    yaml_event_t event;
+    if (!yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING))
+        self->err = -1;
+    else
+        writer_emit(self, &event);
+    return self;
+}
+
+/* Create a writer that sends the output to a callback */
+struct eyamlwriter* eyaml_writer_create(eyamlsink sink, void* data, struct eyamlwriteropts const* opts) {
+    return writer_create(sink, data, -1, opts);
+}
+
+/* Create a writer that sends the output to a file descriptor */
+struct eyamlwriter* eyaml_writer_fd(int fd, struct eyamlwriteropts const* opts) {
+    return writer_create(fdsink, NULL, fd, opts);
+}
+
+/* Open a mapping */
+int eyaml_writer_begin_map(struct eyamlwriter* self) {
+    return writer_begin(self, WRITER_KEY);
+}
+
+/* Open a sequence */
+int eyaml_writer_begin_seq(struct eyamlwriter* self) {
+    return writer_begin(self, WRITER_SEQ);
+}
+
+/* Write the name of the next member of the open mapping */
+int eyaml_writer_key(struct eyamlwriter* self, char const* name) {
+    if (self->err)
+        return self->err;
+    if (NULL == name || 0 == self->depth || WRITER_KEY != self->ctx[self->depth - 1])
+        return self->err = -1;
+    self->ctx[self->depth - 1] = WRITER_VALUE;
+    yaml_event_t event;
+    if (!yaml_scalar_event_initialize(&event, NULL, NULL, (yaml_char_t*)name, -1, 1, 1, YAML_ANY_SCALAR_STYLE))
+        return self->err = -1;
+    return writer_emit(self, &event);
+}
+
+/* Write a scalar value */
+int eyaml_writer_scalar(struct eyamlwriter* self, char const* value) {
+    if (self->err)
+        return self->err;
+    if (NULL == value || 0 == self->depth)
+        return self->err = -1;
+    if (0 < self->pending && self->pending == self->flowseq && writer_release(self, YAML_BLOCK_SEQUENCE_STYLE))
+        return self->err;
+    if (writer_node(self))
+        return self->err;
+    yaml_event_t event;
+    if (!yaml_scalar_event_initialize(&event, NULL, NULL, (yaml_char_t*)value, -1, 1, 1, YAML_ANY_SCALAR_STYLE))
+        return self->err = -1;
+    if (0 <= self->pending) {
+        self->items[self->pending++] = event;
+        return 0;
+    }
+    return writer_emit(self, &event);
+}
+
+/* Close the innermost open collection */
+int eyaml_writer_end(struct eyamlwriter* self) {
+    if (self->err)
+        return self->err;
+    if (0 == self->depth || WRITER_VALUE == self->ctx[self->depth - 1])
+        return self->err = -1;
+    if (0 <= self->pending && writer_release(self, YAML_FLOW_SEQUENCE_STYLE))
+        return self->err;
+    yaml_event_t event;
+    int ok = WRITER_SEQ == self->ctx[--self->depth]
+        ? yaml_sequence_end_event_initialize(&event)
+        : yaml_mapping_end_event_initialize(&event);
+    if (!ok)
+        return self->err = -1;
+    if (writer_emit(self, &event) || self->depth)
+        return self->err;
+    if (!yaml_document_end_event_initialize(&event, 1))
+        return self->err = -1;
+    return writer_emit(self, &event);
+}
+
+/* Send all the text of the complete events to the sink */
+int eyaml_writer_flush(struct eyamlwriter* self) {
+    if (self->err)
+        return self->err;
+    if (!yaml_emitter_flush(&self->emitter) || writer_drain(self))
+        self->err = -1;
+    return self->err;
+}
+
+/* Finish the stream, flush it and destroy the writer */
+int eyaml_writer_close(struct eyamlwriter* self) {
+    int err = self->err;
+    if (0 == err && self->depth)
+        err = -1;
+    yaml_event_t event;
+    if (0 == err) {
+        if (!yaml_stream_end_event_initialize(&event))
+            err = -1;
+        else
+            err = writer_emit(self, &event);
+    }
+    if (0 == err)
+        err = eyaml_writer_flush(self);
+    for(int i = 0; i < self->pending; ++i)
+        yaml_event_delete(self->items + i);
+    yaml_emitter_delete(&self->emitter);
+    free(self->ctx);
+    free(self->buff);
+    free(self);
+    return err;
+}
 
 
 static void printevent(yaml_event_t *event, int* level);
@@ -408,26 +1301,34 @@ void eyaml_debug(struct eyaml* self) {
 
     } while(!stack_isempty(&nodes));
 
+    stack_flush(&nodes);
+
 }
 
-/* Parse a YAML stream */
-int eyaml_parse(struct eyaml** dest, FILE* src) {
+/* Build a tree of easy-yaml nodes from the events of a libyaml parser.
+   The memory of the tree and the stack is taken from a pool if not null */
+static int parse(struct eyaml** dest, yaml_parser_t* parser, struct eyamlopts const* opts, struct pool* pool) {
 
     struct stack wip; // the stack to store Work In Progress yaml nodes
     stack_init(&wip);
 
-    yaml_parser_t parser;
-    yaml_parser_initialize(&parser);
-    yaml_parser_set_input_file(&parser, src);
+    struct tree tree;
+    tree_init(&tree, opts);
+    if (NULL != pool) {
+        tree.pool = pool;
+        wip.spare = pool->items;
+    }
 
+    struct eyaml* last = NULL; // the last child of the node on the top of wip
+    int depth = 0;
     int level = 0;
     int err = -1;
     *dest = NULL;
+    yaml_event_t event;
 
     do {
 
-        yaml_event_t event;
-        err = !yaml_parser_parse(&parser, &event);
+        err = !yaml_parser_parse(parser, &event);
         if (err) {
             fprintf(stderr, "yaml_parser_parse error\n");
             goto done;
@@ -443,9 +1344,13 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     err = -1;
                     goto done;
                 }
-                struct eyaml* node = eyaml_create();
+                struct eyaml* node = tree_node(&tree);
+                if (NULL == node || stack_push(&wip, node)) {
+                    err = NULL == node ? tree.err : -1;
+                    goto done;
+                }
                 node->events[0] = event;
-                stack_push(&wip, node);
+                last = NULL;
                 break;
             }
 
@@ -467,10 +1372,17 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     err = -3;
                     goto done;
                 }
-                struct eyaml* doc = eyaml_create();
+                err = tree_document(&tree);
+                if (err)
+                    goto done;
+                struct eyaml* doc = tree_node(&tree);
+                if (NULL == doc || stack_push(&wip, doc)) {
+                    err = NULL == doc ? tree.err : -1;
+                    goto done;
+                }
                 doc->events[0] = event;
-                eyaml_appned(stream, doc);
-                stack_push(&wip, doc);
+                eyaml_appned(stream, last, doc);
+                last = NULL;
                 break;
             }
 
@@ -482,6 +1394,7 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                 }
                 stack_pop(&wip);
                 doc->events[1] = event;
+                last = doc;
                 break;
             }
 
@@ -491,6 +1404,9 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     err = -5;
                     goto done;
                 }
+                err = tree_depth(&tree, ++depth);
+                if (err)
+                    goto done;
                 int const isdoc = istype(node, YAML_DOCUMENT_START_EVENT, YAML_NO_EVENT, YAML_NO_EVENT);
                 if (isdoc && eyaml_haschildren(node)) {
                     err = -6;
@@ -501,14 +1417,19 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     istype(node, YAML_SEQUENCE_START_EVENT, YAML_NO_EVENT, YAML_NO_EVENT) ||
                     istype(node, YAML_SCALAR_EVENT, YAML_SEQUENCE_START_EVENT, YAML_NO_EVENT)
                 ) {
-                    struct eyaml* map = eyaml_create();
+                    struct eyaml* map = tree_node(&tree);
+                    if (NULL == map || stack_push(&wip, map)) {
+                        err = NULL == map ? tree.err : -1;
+                        goto done;
+                    }
                     map->events[0] = event;
-                    eyaml_appned(node, map);
-                    stack_push(&wip, map);
+                    eyaml_appned(node, last, map);
+                    last = NULL;
                     break;
                 }
                 else if (istype(node, YAML_SCALAR_EVENT, YAML_NO_EVENT, YAML_NO_EVENT)) {
                     node->events[1] = event;
+                    last = NULL;
                 }
                 else {
                     err = -7;
@@ -535,6 +1456,8 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     err = -9;
                     goto done;
                 }
+                --depth;
+                last = map;
                 break;
             }
 
@@ -544,6 +1467,9 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     err = -10;
                     goto done;
                 }
+                err = tree_depth(&tree, ++depth);
+                if (err)
+                    goto done;
                 int const isdoc = istype(node, YAML_DOCUMENT_START_EVENT, YAML_NO_EVENT, YAML_NO_EVENT);
                 if (isdoc && eyaml_haschildren(node)) {
                     err = -11;
@@ -554,14 +1480,19 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     istype(node, YAML_SEQUENCE_START_EVENT, YAML_NO_EVENT, YAML_NO_EVENT) ||
                     istype(node, YAML_SCALAR_EVENT, YAML_SEQUENCE_START_EVENT, YAML_NO_EVENT)
                 ) {
-                    struct eyaml* map = eyaml_create();
+                    struct eyaml* map = tree_node(&tree);
+                    if (NULL == map || stack_push(&wip, map)) {
+                        err = NULL == map ? tree.err : -1;
+                        goto done;
+                    }
                     map->events[0] = event;
-                    eyaml_appned(node, map);
-                    stack_push(&wip, map);
+                    eyaml_appned(node, last, map);
+                    last = NULL;
                     break;
                 }
                 else if (istype(node, YAML_SCALAR_EVENT, YAML_NO_EVENT, YAML_NO_EVENT)) {
                     node->events[1] = event;
+                    last = NULL;
                 }
                 else {
                     err = -12;
@@ -588,31 +1519,46 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
                     err = -14;
                     goto done;
                 }
+                --depth;
+                last = seq;
                 break;
             }
 
             case YAML_SCALAR_EVENT: {
+                err = tree_scalar(&tree, event.data.scalar.length);
+                if (err)
+                    goto done;
                 struct eyaml* node = stack_pick(&wip);
                 if (
                     istype(node, YAML_SEQUENCE_START_EVENT, YAML_NO_EVENT, YAML_NO_EVENT) ||
                     istype(node, YAML_SCALAR_EVENT, YAML_SEQUENCE_START_EVENT, YAML_NO_EVENT)
                 ) {
-                    struct eyaml* scalar = eyaml_create();
+                    struct eyaml* scalar = tree_node(&tree);
+                    if (NULL == scalar) {
+                        err = tree.err;
+                        goto done;
+                    }
                     scalar->events[0] = event;
-                    eyaml_appned(node, scalar);
+                    eyaml_appned(node, last, scalar);
+                    last = scalar;
                 }
                 else if (
                     istype(node, YAML_MAPPING_START_EVENT, YAML_NO_EVENT, YAML_NO_EVENT) ||
                     istype(node, YAML_SCALAR_EVENT, YAML_MAPPING_START_EVENT, YAML_NO_EVENT)
                 ) {
-                    struct eyaml* scalar = eyaml_create();
+                    struct eyaml* scalar = tree_node(&tree);
+                    if (NULL == scalar || stack_push(&wip, scalar)) {
+                        err = NULL == scalar ? tree.err : -1;
+                        goto done;
+                    }
                     scalar->events[0] = event;
-                    eyaml_appned(node, scalar);
-                    stack_push(&wip, scalar);
+                    eyaml_appned(node, last, scalar);
+                    last = NULL;
                 }
                 else if (istype(node, YAML_SCALAR_EVENT, YAML_NO_EVENT, YAML_NO_EVENT)) {
                     stack_pop(&wip);
                     node->events[1] = event;
+                    last = node;
                 }
                 else {
                     err = -14;
@@ -634,17 +1580,2226 @@ int eyaml_parse(struct eyaml** dest, FILE* src) {
     err = 0;
 
   done:
-    if ( !stack_isempty(&wip) ) {
-        struct eyaml* root = NULL;
-        do root = stack_pop(&wip);
-            while(!stack_isempty(&wip));
-        eyaml_destroy(root);
-        if ( 0 == err )
-            err = -20;
+    if (NULL != pool) {
+        stack_clear(&wip);
+        pool->items = wip.spare;
     }
+    else
+        stack_flush(&wip);
+    if (err) {
+        yaml_event_delete(&event); // not yet owned by the tree
+        tree_free(&tree);
+        *dest = NULL;
+    }
+    return err;
+}
 
+/* Input stream of libyaml that counts the bytes read */
+struct input {
+    FILE* file;
+    size_t bytes;
+    size_t limit; /* Zero for no limit */
+};
 
+/* Read handler of libyaml. It reads up to one byte beyond the limit to
+   detect when it is exceeded and then fails */
+static int readinput(void* data, unsigned char* buffer, size_t size, size_t* length) {
+    struct input* in = data;
+    if (0 != in->limit && size > in->limit - in->bytes + 1)
+        size = in->limit - in->bytes + 1;
+    *length = fread(buffer, 1, size, in->file);
+    in->bytes += *length;
+    return !ferror(in->file) && !overlimit(in->bytes, in->limit);
+}
 
+/* Parse a YAML stream */
+int eyaml_parse(struct eyaml** dest, FILE* src) {
+    return eyaml_parse_opts(dest, src, NULL);
+}
+
+/* Parse a YAML stream within some resource limits */
+int eyaml_parse_opts(struct eyaml** dest, FILE* src, struct eyamlopts const* opts) {
+    yaml_parser_t parser;
+    if (!yaml_parser_initialize(&parser))
+        return -1;
+    struct input in = { .file = src, .bytes = 0, .limit = NULL != opts ? opts->maxbytes : 0 };
+    yaml_parser_set_input(&parser, readinput, &in);
+    int err = parse(dest, &parser, opts, NULL);
+    if (err && overlimit(in.bytes, in.limit))
+        err = EYAML_EBYTES;
+    yaml_parser_delete(&parser);
+    return err;
+}
+
+/* --------------------------------------------------------------------- */
+/* ------------------------- Compressed inputs ------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* The compressed input is decoded as LIBYAML pulls it through its read
+   handler, so only the buffers of the decoder are held in memory. With
+   EYAML_THREADED a second thread decodes into a bounded ring buffer while
+   the tree is built. The codecs are compiled in with EYAML_ZLIB for gzip
+   and EYAML_ZSTD for zstd. */
+
+/* Codecs of the compressed inputs */
+enum codec { CODEC_PLAIN, CODEC_GZIP, CODEC_ZSTD };
+
+/* Size of the buffer of compressed bytes */
+#define DECODER_INSIZE 65536
+
+/* Decoder of a compressed stream */
+struct decoder {
+    FILE* file;
+    enum codec codec;
+    int eof;     /* No more compressed bytes in the file */
+    int end;     /* No more decoded bytes */
+    int whole;   /* The last gzip member or zstd frame is complete */
+    size_t inpos;
+    size_t inlen;
+#ifdef EYAML_ZLIB
+    z_stream zlib;
+#endif
+#ifdef EYAML_ZSTD
+    ZSTD_DStream* zstd;
+#endif
+    unsigned char in[DECODER_INSIZE];
+};
+
+/* Fill the buffer of compressed bytes if it is empty */
+static int decoder_fill(struct decoder* self) {
+    if (self->inpos < self->inlen || self->eof)
+        return 0;
+    self->inpos = 0;
+    self->inlen = fread(self->in, 1, sizeof self->in, self->file);
+    if (ferror(self->file))
+        return -1;
+    self->eof = self->inlen < sizeof self->in;
+    return 0;
+}
+
+/* Initialize a decoder detecting the codec by the magic bytes.
+   Return EYAML_UNSUPPORTED if the codec is not compiled in */
+static int decoder_init(struct decoder* self, FILE* file) {
+    self->file = file;
+    self->eof = 0;
+    self->end = 0;
+    self->whole = 1;
+    self->inpos = 0;
+    self->inlen = 0;
+    if (decoder_fill(self))
+        return -1;
+    unsigned char const* p = self->in;
+    if (self->inlen >= 2 && 0x1f == p[0] && 0x8b == p[1])
+        self->codec = CODEC_GZIP;
+    else if (self->inlen >= 4 && 0x28 == p[0] && 0xb5 == p[1] && 0x2f == p[2] && 0xfd == p[3])
+        self->codec = CODEC_ZSTD;
+    else
+        self->codec = CODEC_PLAIN;
+    self->whole = CODEC_PLAIN == self->codec;
+    switch(self->codec) {
+        case CODEC_PLAIN:
+            return 0;
+        case CODEC_GZIP:
+#ifdef EYAML_ZLIB
+            memset(&self->zlib, 0, sizeof self->zlib);
+            return Z_OK == inflateInit2(&self->zlib, 15 + 16) ? 0 : -1;
+#else
+            return EYAML_UNSUPPORTED;
+#endif
+        case CODEC_ZSTD:
+#ifdef EYAML_ZSTD
+            self->zstd = ZSTD_createDStream();
+            if (NULL == self->zstd)
+                return -1;
+            return ZSTD_isError(ZSTD_initDStream(self->zstd)) ? -1 : 0;
+#else
+            return EYAML_UNSUPPORTED;
+#endif
+    }
+    return -1;
+}
+
+/* Release the resources of a decoder */
+static void decoder_free(struct decoder* self) {
+#ifdef EYAML_ZLIB
+    if (CODEC_GZIP == self->codec)
+        inflateEnd(&self->zlib);
+#endif
+#ifdef EYAML_ZSTD
+    if (CODEC_ZSTD == self->codec)
+        ZSTD_freeDStream(self->zstd);
+#endif
+}
+
+/* Decode up to 'size' bytes. A zero length is the end of the stream.
+   Once the file is read, the codec is still called until its last member
+   or frame is complete, to get the output it holds or detect a truncation */
+static int decoder_read(struct decoder* self, unsigned char* dest, size_t size, size_t* len) {
+    *len = 0;
+    while (0 == *len && !self->end) {
+        if (decoder_fill(self))
+            return -1;
+        size_t const avail = self->inlen - self->inpos;
+        if (0 == avail && self->eof && self->whole) {
+            self->end = 1;
+            break;
+        }
+        if (CODEC_PLAIN == self->codec) {
+            *len = avail < size ? avail : size;
+            memcpy(dest, self->in + self->inpos, *len);
+            self->inpos += *len;
+        }
+#ifdef EYAML_ZLIB
+        else if (CODEC_GZIP == self->codec) {
+            z_stream* z = &self->zlib;
+            z->next_in = self->in + self->inpos;
+            z->avail_in = avail;
+            z->next_out = dest;
+            z->avail_out = size;
+            int const rslt = inflate(z, Z_NO_FLUSH);
+            self->inpos = self->inlen - z->avail_in;
+            *len = size - z->avail_out;
+            self->whole = Z_STREAM_END == rslt;
+            if (Z_STREAM_END == rslt) {
+                /* A gzip file can be made of several members */
+                if (Z_OK != inflateReset(z))
+                    return -1;
+            }
+            else if (Z_BUF_ERROR == rslt && self->eof && 0 == z->avail_in)
+                return -1; /* Truncated */
+            else if (Z_OK != rslt && Z_BUF_ERROR != rslt)
+                return -1;
+        }
+#endif
+#ifdef EYAML_ZSTD
+        else if (CODEC_ZSTD == self->codec) {
+            ZSTD_inBuffer in = { self->in + self->inpos, avail, 0 };
+            ZSTD_outBuffer out = { dest, size, 0 };
+            size_t const rslt = ZSTD_decompressStream(self->zstd, &out, &in);
+            if (ZSTD_isError(rslt))
+                return -1;
+            self->inpos += in.pos;
+            *len = out.pos;
+            self->whole = 0 == rslt;
+            if (0 != rslt && self->eof && self->inpos == self->inlen && 0 == out.pos)
+                return -1; /* Truncated */
+        }
+#endif
+    }
+    return 0;
+}
+
+/* Size of the ring buffer between the decoder thread and the parser */
+#define RING_SIZE (256 * 1024)
+
+/* Decoded input of LIBYAML, straight from the decoder or through a ring
+   buffer filled by a second thread */
+struct pipeline {
+    struct decoder decoder;
+    size_t bytes;    /* Number of decoded bytes read by LIBYAML */
+    size_t limit;    /* Zero for no limit */
+    int threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    pthread_cond_t writable;
+    size_t head;     /* Total bytes written into the ring */
+    size_t tail;     /* Total bytes read from the ring */
+    int done;        /* The decoder thread finished */
+    int err;         /* The decoder thread failed */
+    int closed;      /* The parser stopped reading */
+    unsigned char ring[];
+};
+
+/* Body of the decoder thread. It decodes straight into the free span of
+   the ring and publishes the bytes under the lock */
+static void* pipeline_run(void* data) {
+    struct pipeline* self = data;
+    int err = 0;
+    for(;;) {
+        pthread_mutex_lock(&self->lock);
+        while (RING_SIZE == self->head - self->tail && !self->closed)
+            pthread_cond_wait(&self->writable, &self->lock);
+        int const closed = self->closed;
+        size_t const pos = self->head % RING_SIZE;
+        size_t const room = RING_SIZE - (self->head - self->tail);
+        pthread_mutex_unlock(&self->lock);
+        if (closed)
+            break;
+        size_t const span = room < RING_SIZE - pos ? room : RING_SIZE - pos;
+        size_t len;
+        err = decoder_read(&self->decoder, self->ring + pos, span, &len);
+        if (err || 0 == len)
+            break;
+        pthread_mutex_lock(&self->lock);
+        self->head += len;
+        pthread_cond_signal(&self->readable);
+        pthread_mutex_unlock(&self->lock);
+    }
+    pthread_mutex_lock(&self->lock);
+    self->done = 1;
+    self->err = err;
+    pthread_cond_signal(&self->readable);
+    pthread_mutex_unlock(&self->lock);
+    return NULL;
+}
+
+/* Read handler of LIBYAML for a pipeline */
+static int readpipeline(void* data, unsigned char* buffer, size_t size, size_t* length) {
+    struct pipeline* self = data;
+    if (0 != self->limit && size > self->limit - self->bytes + 1)
+        size = self->limit - self->bytes + 1;
+    int err = 0;
+    if (!self->threaded)
+        err = decoder_read(&self->decoder, buffer, size, length);
+    else {
+        pthread_mutex_lock(&self->lock);
+        while (self->head == self->tail && !self->done)
+            pthread_cond_wait(&self->readable, &self->lock);
+        size_t const pos = self->tail % RING_SIZE;
+        size_t const avail = self->head - self->tail;
+        size_t const span = avail < RING_SIZE - pos ? avail : RING_SIZE - pos;
+        *length = span < size ? span : size;
+        err = 0 == avail && self->err;
+        pthread_mutex_unlock(&self->lock);
+        memcpy(buffer, self->ring + pos, *length);
+        pthread_mutex_lock(&self->lock);
+        self->tail += *length;
+        pthread_cond_signal(&self->writable);
+        pthread_mutex_unlock(&self->lock);
+    }
+    self->bytes += *length;
+    return !err && !overlimit(self->bytes, self->limit);
+}
+
+/* Parse a YAML stream that may be compressed */
+int eyaml_parse_compressed(struct eyaml** dest, FILE* src, int flags, struct eyamlopts const* opts) {
+    *dest = NULL;
+    int const threaded = 0 != (flags & EYAML_THREADED);
+    struct pipeline* pipe = malloc(sizeof *pipe + (threaded ? RING_SIZE : 0));
+    if (NULL == pipe)
+        return -1;
+    int err = decoder_init(&pipe->decoder, src);
+    if (err) {
+        free(pipe);
+        return err;
+    }
+    pipe->bytes = 0;
+    pipe->limit = NULL != opts ? opts->maxbytes : 0;
+    pipe->threaded = threaded;
+    pipe->head = 0;
+    pipe->tail = 0;
+    pipe->done = 0;
+    pipe->err = 0;
+    pipe->closed = 0;
+    if (threaded) {
+        pthread_mutex_init(&pipe->lock, NULL);
+        pthread_cond_init(&pipe->readable, NULL);
+        pthread_cond_init(&pipe->writable, NULL);
+        if (pthread_create(&pipe->thread, NULL, pipeline_run, pipe)) {
+            err = -1;
+            goto done;
+        }
+    }
+    yaml_parser_t parser;
+    if (!yaml_parser_initialize(&parser))
+        err = -1;
+    else {
+        yaml_parser_set_input(&parser, readpipeline, pipe);
+        err = parse(dest, &parser, opts, NULL);
+        if (err && overlimit(pipe->bytes, pipe->limit))
+            err = EYAML_EBYTES;
+        yaml_parser_delete(&parser);
+    }
+    if (threaded) {
+        pthread_mutex_lock(&pipe->lock);
+        pipe->closed = 1;
+        pthread_cond_signal(&pipe->writable);
+        pthread_mutex_unlock(&pipe->lock);
+        pthread_join(pipe->thread, NULL);
+    }
+
+  done:
+    if (threaded) {
+        pthread_cond_destroy(&pipe->writable);
+        pthread_cond_destroy(&pipe->readable);
+        pthread_mutex_destroy(&pipe->lock);
+    }
+    decoder_free(&pipe->decoder);
+    free(pipe);
+    return err;
+}
+
+/* --------------------------------------------------------------------- */
+/* ---------- Native scanner for the common block-style subset ---------- */
+/* --------------------------------------------------------------------- */
+
+/* The native scanner builds the same nodes and events that the libyaml
+   path builds, but only for plain block mappings, block sequences, flow
+   sequences of scalars and single-line quoted scalars. On anything else
+   it gives up with EYAML_UNSUPPORTED and the caller goes through libyaml,
+   so both paths always agree. It is also conservative with the bytes it
+   accepts: tabs, carriage returns and non-ASCII text are left to libyaml. */
+
+/* Maximum nesting handled by the native scanner */
+#define NATIVE_MAXDEPTH 64
+
+/* Longest implicit key accepted by libyaml */
+#define NATIVE_MAXKEY 1024
+
+/* Check if a byte must be looked at by the native scanner */
+static int isspecial(unsigned char c) {
+    switch(c) {
+        case ':': case '#': case '\'': case '"': case '\\':
+        case ',': case '[': case ']': case '{': case '}':
+            return 1;
+        default:
+            return c < 0x20 || c >= 0x7f;
+    }
+}
+
+/* Check if a special byte can not be handled by the native scanner */
+static int isunsafe(unsigned char c) {
+    return ( c < 0x20 && '\n' != c ) || c >= 0x7f;
+}
+
+/* Get the first special byte of a buffer, 'end' if there is none */
+static char const* nextspecial(char const* p, char const* end) {
+#if defined(__AVX2__)
+    while (end - p >= 32) {
+        __m256i const x = _mm256_loadu_si256((__m256i const*)p);
+        __m256i m = _mm256_or_si256(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), x),
+            _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x7f)));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(':')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('#')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(',')));
+        /* '[' and '{' differ in one bit as ']' and '}' do */
+        __m256i const y = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(y, _mm256_set1_epi8('{')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(y, _mm256_set1_epi8('}')));
+        unsigned const mask = _mm256_movemask_epi8(m);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        __m128i const x = _mm_loadu_si128((__m128i const*)p);
+        __m128i m = _mm_or_si128(
+            _mm_cmplt_epi8(x, _mm_set1_epi8(0x20)),
+            _mm_cmpeq_epi8(x, _mm_set1_epi8(0x7f)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(':')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('#')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\'')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(',')));
+        /* '[' and '{' differ in one bit as ']' and '}' do */
+        __m128i const y = _mm_or_si128(x, _mm_set1_epi8(0x20));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(y, _mm_set1_epi8('{')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(y, _mm_set1_epi8('}')));
+        unsigned const mask = _mm_movemask_epi8(m);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && !isspecial(*p))
+        ++p;
+    return p;
+}
+
+/* Block collection whose entries are being scanned */
+struct level {
+    struct eyaml* node; /* Node that holds the entries as children */
+    struct eyaml* last; /* Last child appended */
+    int slot;           /* Index of the event where the closing event goes */
+    int indent;         /* Column of the entries */
+    int seq;            /* Non-zero for sequences, zero for mappings */
+    int compact;        /* Sequence at the same column as its mapping key */
+};
+
+/* State of the native scanner */
+struct native {
+    char const* line;    /* Start of the line being scanned */
+    char const* end;     /* End of the input */
+    struct eyaml* stream;
+    struct eyaml* lastdoc;
+    struct eyaml* doc;   /* Open document, null if none */
+    struct eyaml* pending; /* Node whose value starts in a following line */
+    int pendingslot;     /* Event index of the value of the pending node */
+    int depth;
+    struct tree tree;    /* Nodes of the tree being built */
+    struct level levels[NATIVE_MAXDEPTH];
+};
+
+/* Check if a position is the end of a line */
+static int iseol(struct native const* s, char const* p) {
+    return p >= s->end || '\n' == *p;
+}
+
+/* Check if a position is the end of a line or a blank */
+static int isblankeol(struct native const* s, char const* p) {
+    return iseol(s, p) || ' ' == *p;
+}
+
+/* Skip spaces */
+static char const* skipspaces(struct native const* s, char const* p) {
+    while (p < s->end && ' ' == *p)
+        ++p;
+    return p;
+}
+
+/* Check that only blanks or a comment remain in the line.
+   On success '*pp' is updated to the start of the next line */
+static int native_eol(struct native const* s, char const** pp) {
+    char const* p = *pp;
+    char const* q = skipspaces(s, p);
+    if (!iseol(s, q)) {
+        if ('#' != *q || (q == p && q != s->line))
+            return EYAML_UNSUPPORTED;
+        do {
+            q = nextspecial(q + 1, s->end);
+            if (q < s->end && isunsafe(*q))
+                return EYAML_UNSUPPORTED;
+        } while (!iseol(s, q));
+    }
+    *pp = q < s->end ? q + 1 : q;
+    return 0;
+}
+
+/* Initialize the event of an untagged scalar that takes its value */
+static void setscalar(yaml_event_t* event, yaml_char_t* value, int len, yaml_scalar_style_t style) {
+    memset(event, 0, sizeof *event);
+    event->type = YAML_SCALAR_EVENT;
+    event->data.scalar.value = value;
+    event->data.scalar.length = len;
+    event->data.scalar.plain_implicit  = YAML_PLAIN_SCALAR_STYLE == style;
+    event->data.scalar.quoted_implicit = YAML_PLAIN_SCALAR_STYLE != style;
+    event->data.scalar.style = style;
+}
+
+/* Initialize the event of a scalar copying its value */
+static int native_scalar(struct tree const* tree, yaml_event_t* event, char const* str, int len, yaml_scalar_style_t style) {
+    yaml_char_t* value = malloc(len + 1);
+    if (NULL == value)
+        return -1;
+    int n = 0;
+    for(int i = 0; i < len; ++i) {
+        value[n++] = str[i];
+        if ('\'' == str[i] && YAML_SINGLE_QUOTED_SCALAR_STYLE == style)
+            ++i; /* '' is an escaped quote */
+    }
+    value[n] = '\0';
+    int err = tree_scalar(tree, n);
+    if (err) {
+        free(value);
+        return err;
+    }
+    setscalar(event, value, n, style);
+    return 0;
+}
+
+/* Initialize the event of a null scalar */
+static int native_empty(struct tree const* tree, yaml_event_t* event) {
+    return native_scalar(tree, event, "", 0, YAML_PLAIN_SCALAR_STYLE);
+}
+
+/* Initialize a start or end event of a collection */
+static void native_collection(yaml_event_t* event, yaml_event_type_t type, int flow) {
+    memset(event, 0, sizeof *event);
+    event->type = type;
+    if (YAML_MAPPING_START_EVENT == type) {
+        event->data.mapping_start.implicit = 1;
+        event->data.mapping_start.style = flow ? YAML_FLOW_MAPPING_STYLE : YAML_BLOCK_MAPPING_STYLE;
+    }
+    else if (YAML_SEQUENCE_START_EVENT == type) {
+        event->data.sequence_start.implicit = 1;
+        event->data.sequence_start.style = flow ? YAML_FLOW_SEQUENCE_STYLE : YAML_BLOCK_SEQUENCE_STYLE;
+    }
+}
+
+/* Append a child to the collection on the top of the levels */
+static void native_append(struct native* s, struct eyaml* child) {
+    struct level* top = s->levels + s->depth - 1;
+    if (NULL == top->last)
+        top->node->child = child;
+    else
+        top->last->sibling = child;
+    top->last = child;
+}
+
+/* Open a block collection as the value of a node */
+static int native_open(struct native* s, struct eyaml* node, int slot, int indent, int seq) {
+    int err = tree_depth(&s->tree, s->depth + 1);
+    if (err)
+        return err;
+    if (NATIVE_MAXDEPTH == s->depth)
+        return EYAML_UNSUPPORTED;
+    yaml_event_type_t const type = seq ? YAML_SEQUENCE_START_EVENT : YAML_MAPPING_START_EVENT;
+    native_collection(node->events + slot, type, 0);
+    struct level* lvl = s->levels + s->depth++;
+    lvl->node = node;
+    lvl->last = NULL;
+    lvl->slot = slot + 1;
+    lvl->indent = indent;
+    lvl->seq = seq;
+    lvl->compact = 0;
+    return 0;
+}
+
+/* Close the block collection on the top of the levels */
+static void native_close(struct native* s) {
+    struct level* lvl = s->levels + --s->depth;
+    yaml_event_type_t const type = lvl->seq ? YAML_SEQUENCE_END_EVENT : YAML_MAPPING_END_EVENT;
+    native_collection(lvl->node->events + lvl->slot, type, 0);
+}
+
+/* Give a null value to the pending node if any */
+static int native_settle(struct native* s) {
+    if (NULL == s->pending)
+        return 0;
+    struct eyaml* node = s->pending;
+    s->pending = NULL;
+    return native_empty(&s->tree, node->events + s->pendingslot);
+}
+
+/* Scan a quoted scalar that must end in the same line.
+   On success '*pp' points to the byte after the closing quote */
+static int native_quoted(struct native const* s, char const** pp, char const** str, int* len) {
+    char const quote = **pp;
+    char const* p = *pp + 1;
+    *str = p;
+    for(;;) {
+        p = nextspecial(p, s->end);
+        if (iseol(s, p) || isunsafe(*p))
+            return EYAML_UNSUPPORTED;
+        if (quote == *p) {
+            if ('\'' == quote && p + 1 < s->end && '\'' == p[1]) {
+                p += 2;
+                continue;
+            }
+            break;
+        }
+        if ('"' == quote && '\\' == *p)
+            return EYAML_UNSUPPORTED;
+        ++p;
+    }
+    *len = p - *str;
+    *pp = p + 1;
+    return 0;
+}
+
+/* Scan a plain scalar in block context up to the end of the line or a comment.
+   On success '*pp' points to the end of the scalar */
+static int native_plain(struct native const* s, char const** pp, int* len) {
+    char const* const start = *pp;
+    char const* p = start;
+    for(;;) {
+        p = nextspecial(p, s->end);
+        if (iseol(s, p))
+            break;
+        if (isunsafe(*p))
+            return EYAML_UNSUPPORTED;
+        if (':' == *p && isblankeol(s, p + 1))
+            return EYAML_UNSUPPORTED;
+        if ('#' == *p && ' ' == p[-1])
+            break;
+        ++p;
+    }
+    while (p > start && ' ' == p[-1])
+        --p;
+    *len = p - start;
+    *pp = p;
+    return 0;
+}
+
+/* Check if a scalar can not start with a byte in the native subset */
+static int isindicator(struct native const* s, char const* p) {
+    switch(*p) {
+        case '-': case '?': case ':':
+            return isblankeol(s, p + 1);
+        case '[': case ']': case '{': case '}': case ',': case '#':
+        case '&': case '*': case '!': case '|': case '>':
+        case '%': case '@': case '`': case '\'': case '"':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Scan a flow sequence of scalars that must end in the same line.
+   On success '*pp' points to the byte after the closing bracket */
+static int native_flow(struct native* s, struct eyaml* node, int slot, char const** pp) {
+    int err = tree_depth(&s->tree, s->depth + 1);
+    if (err)
+        return err;
+    native_collection(node->events + slot, YAML_SEQUENCE_START_EVENT, 1);
+    native_collection(node->events + slot + 1, YAML_SEQUENCE_END_EVENT, 1);
+    struct eyaml* last = NULL;
+    char const* p = skipspaces(s, *pp + 1);
+    if (p < s->end && ']' == *p) {
+        *pp = p + 1;
+        return 0;
+    }
+    for(;;) {
+        if (iseol(s, p))
+            return EYAML_UNSUPPORTED;
+        char const* str = p;
+        int len;
+        yaml_scalar_style_t style = YAML_PLAIN_SCALAR_STYLE;
+        if ('\'' == *p || '"' == *p) {
+            style = '"' == *p ? YAML_DOUBLE_QUOTED_SCALAR_STYLE : YAML_SINGLE_QUOTED_SCALAR_STYLE;
+            err = native_quoted(s, &p, &str, &len);
+            if (err)
+                return err;
+        }
+        else if (isindicator(s, p))
+            return EYAML_UNSUPPORTED;
+        else {
+            for(;;) {
+                p = nextspecial(p, s->end);
+                if (iseol(s, p) || isunsafe(*p))
+                    return EYAML_UNSUPPORTED;
+                if (',' == *p || ']' == *p)
+                    break;
+                if ('[' == *p || '{' == *p || '}' == *p)
+                    return EYAML_UNSUPPORTED;
+                if (':' == *p && (isblankeol(s, p + 1) || NULL != strchr(",[]{}", p[1])))
+                    return EYAML_UNSUPPORTED;
+                if ('#' == *p && ' ' == p[-1])
+                    return EYAML_UNSUPPORTED;
+                ++p;
+            }
+            char const* q = p;
+            while (q > str && ' ' == q[-1])
+                --q;
+            len = q - str;
+        }
+        struct eyaml* item = tree_node(&s->tree);
+        if (NULL == item)
+            return s->tree.err;
+        err = native_scalar(&s->tree, item->events, str, len, style);
+        if (err)
+            return err;
+        if (NULL == last)
+            node->child = item;
+        else
+            last->sibling = item;
+        last = item;
+        p = skipspaces(s, p);
+        if (iseol(s, p))
+            return EYAML_UNSUPPORTED;
+        if (']' == *p)
+            break;
+        if (',' != *p)
+            return EYAML_UNSUPPORTED;
+        p = skipspaces(s, p + 1);
+        if (p < s->end && ']' == *p)
+            return EYAML_UNSUPPORTED; /* Trailing commas are left to libyaml */
+    }
+    *pp = p + 1;
+    return 0;
+}
+
+/* Scan the value of a node that starts in the current line */
+static int native_value(struct native* s, struct eyaml* node, int slot, char const** pp) {
+    char const* p = *pp;
+    int err;
+    if ('[' == *p)
+        err = native_flow(s, node, slot, &p);
+    else if ('\'' == *p || '"' == *p) {
+        yaml_scalar_style_t const style = '"' == *p ? YAML_DOUBLE_QUOTED_SCALAR_STYLE : YAML_SINGLE_QUOTED_SCALAR_STYLE;
+        char const* str;
+        int len;
+        err = native_quoted(s, &p, &str, &len);
+        if (!err)
+            err = native_scalar(&s->tree, node->events + slot, str, len, style);
+    }
+    else if (isindicator(s, p))
+        return EYAML_UNSUPPORTED;
+    else {
+        char const* str = p;
+        int len;
+        err = native_plain(s, &p, &len);
+        if (!err)
+            err = native_scalar(&s->tree, node->events + slot, str, len, YAML_PLAIN_SCALAR_STYLE);
+    }
+    if (err)
+        return err;
+    *pp = p;
+    return native_eol(s, pp);
+}
+
+/* Find the colon of a mapping key at the start of a scalar.
+   Return null if the scalar is not a mapping key */
+static char const* native_findkey(struct native const* s, char const* p) {
+    if ('\'' == *p || '"' == *p) {
+        char const* str;
+        int len;
+        if (native_quoted(s, &p, &str, &len))
+            return NULL;
+        p = skipspaces(s, p);
+        return p < s->end && ':' == *p && isblankeol(s, p + 1) ? p : NULL;
+    }
+    for(;;) {
+        p = nextspecial(p, s->end);
+        if (iseol(s, p) || isunsafe(*p))
+            return NULL;
+        if (':' == *p && isblankeol(s, p + 1))
+            return p;
+        if ('#' == *p && ' ' == p[-1])
+            return NULL;
+        ++p;
+    }
+}
+
+/* Scan a mapping entry */
+static int native_entry(struct native* s, char const* p) {
+    if (isindicator(s, p) && '\'' != *p && '"' != *p)
+        return EYAML_UNSUPPORTED;
+    char const* colon = native_findkey(s, p);
+    if (NULL == colon || colon - p >= NATIVE_MAXKEY)
+        return EYAML_UNSUPPORTED;
+    struct eyaml* key = tree_node(&s->tree);
+    if (NULL == key)
+        return s->tree.err;
+    native_append(s, key);
+    char const* str = p;
+    int len;
+    yaml_scalar_style_t style = YAML_PLAIN_SCALAR_STYLE;
+    if ('\'' == *p || '"' == *p) {
+        style = '"' == *p ? YAML_DOUBLE_QUOTED_SCALAR_STYLE : YAML_SINGLE_QUOTED_SCALAR_STYLE;
+        native_quoted(s, &p, &str, &len);
+    }
+    else {
+        char const* q = colon;
+        while (q > str && ' ' == q[-1])
+            --q;
+        len = q - str;
+    }
+    int err = native_scalar(&s->tree, key->events, str, len, style);
+    if (err)
+        return err;
+    p = skipspaces(s, colon + 1);
+    if (iseol(s, p) || '#' == *p) {
+        s->pending = key;
+        s->pendingslot = 1;
+        p = colon + 1;
+        return native_eol(s, &p);
+    }
+    return native_value(s, key, 1, &p);
+}
+
+/* Scan a block sequence entry */
+static int native_item(struct native* s, char const* p) {
+    struct eyaml* item = tree_node(&s->tree);
+    if (NULL == item)
+        return s->tree.err;
+    native_append(s, item);
+    char const* const dash = p;
+    p = skipspaces(s, p + 1);
+    if (iseol(s, p) || '#' == *p) {
+        s->pending = item;
+        s->pendingslot = 0;
+        p = dash + 1;
+        return native_eol(s, &p);
+    }
+    if ('-' == *p && isblankeol(s, p + 1))
+        return EYAML_UNSUPPORTED;
+    if (NULL != native_findkey(s, p)) {
+        int err = native_open(s, item, 0, p - s->line, 0);
+        if (err)
+            return err;
+        return native_entry(s, p);
+    }
+    return native_value(s, item, 0, &p);
+}
+
+/* Scan a line with content of a document */
+static int native_line(struct native* s, char const* p) {
+    int const indent = p - s->line;
+    int const isdash = '-' == *p && isblankeol(s, p + 1);
+    if (NULL != s->pending) {
+        struct level const* top = s->levels + s->depth - 1;
+        int const nested = indent > top->indent || (isdash && !top->seq && indent == top->indent);
+        if (nested) {
+            struct eyaml* node = s->pending;
+            s->pending = NULL;
+            int err = native_open(s, node, s->pendingslot, indent, isdash);
+            if (err)
+                return err;
+            s->levels[s->depth - 1].compact = indent == top->indent;
+        }
+        else {
+            int err = native_settle(s);
+            if (err)
+                return err;
+        }
+    }
+    else if (NULL == s->doc->child) {
+        struct eyaml* root = tree_node(&s->tree);
+        if (NULL == root)
+            return s->tree.err;
+        s->doc->child = root;
+        int err = native_open(s, root, 0, indent, isdash);
+        if (err)
+            return err;
+    }
+    while (s->depth > 0) {
+        struct level const* top = s->levels + s->depth - 1;
+        if (top->indent < indent || (top->indent == indent && (!top->compact || isdash)))
+            break;
+        native_close(s);
+    }
+    if (0 == s->depth)
+        return EYAML_UNSUPPORTED;
+    struct level const* top = s->levels + s->depth - 1;
+    if (top->indent != indent || top->seq != isdash)
+        return EYAML_UNSUPPORTED;
+    return isdash ? native_item(s, p) : native_entry(s, p);
+}
+
+/* Open a document */
+static int native_docstart(struct native* s, int implicit) {
+    int err = tree_document(&s->tree);
+    if (err)
+        return err;
+    struct eyaml* doc = tree_node(&s->tree);
+    if (NULL == doc)
+        return s->tree.err;
+    doc->events[0].type = YAML_DOCUMENT_START_EVENT;
+    doc->events[0].data.document_start.implicit = implicit;
+    if (NULL == s->lastdoc)
+        s->stream->child = doc;
+    else
+        s->lastdoc->sibling = doc;
+    s->lastdoc = doc;
+    s->doc = doc;
+    return 0;
+}
+
+/* Close the open document */
+static int native_docend(struct native* s, int implicit) {
+    int err = native_settle(s);
+    if (err)
+        return err;
+    while (s->depth > 0)
+        native_close(s);
+    struct eyaml* doc = s->doc;
+    if (NULL == doc->child)
+        return EYAML_UNSUPPORTED; /* Scalar documents are left to libyaml */
+    doc->events[1].type = YAML_DOCUMENT_END_EVENT;
+    doc->events[1].data.document_end.implicit = implicit;
+    s->doc = NULL;
+    return 0;
+}
+
+/* Check if a line is a document marker as '---' or '...' */
+static int ismarker(struct native const* s, char const* p, char c) {
+    return s->end - p >= 3 && c == p[0] && c == p[1] && c == p[2] && isblankeol(s, p + 3);
+}
+
+/* Scan the lines of the input up to its end. The end must be the end of a
+   line, all the state is kept in the scanner, so it can go on later with
+   the lines that follow */
+static int native_lines(struct native* s, char const* p) {
+    for(;;) {
+        s->line = p;
+        p = skipspaces(s, p);
+        if (p >= s->end)
+            break;
+        if ('\n' == *p) {
+            ++p;
+            continue;
+        }
+        int err;
+        if ('#' == *p) {
+            p = s->line;
+            err = native_eol(s, &p);
+        }
+        else if (p == s->line && ismarker(s, p, '-')) {
+            err = NULL != s->doc ? native_docend(s, 1) : 0;
+            if (err)
+                return err;
+            p += 3;
+            err = native_docstart(s, 0);
+            if (!err)
+                err = native_eol(s, &p);
+        }
+        else if (p == s->line && ismarker(s, p, '.')) {
+            if (NULL == s->doc)
+                return EYAML_UNSUPPORTED;
+            p += 3;
+            err = native_docend(s, 0);
+            if (!err)
+                err = native_eol(s, &p);
+        }
+        else {
+            if (NULL == s->doc) {
+                if (NULL != s->lastdoc)
+                    return EYAML_UNSUPPORTED;
+                err = native_docstart(s, 1);
+                if (err)
+                    return err;
+            }
+            err = native_line(s, p);
+            if (!err)
+                p = memchr(s->line, '\n', s->end - s->line);
+            p = NULL == p ? s->end : p + 1;
+        }
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+/* Scan the whole input */
+static int native_stream(struct native* s, char const* p) {
+    int err = native_lines(s, p);
+    if (err)
+        return err;
+    if (NULL != s->doc)
+        return native_docend(s, 1);
+    return 0;
+}
+
+/* Initialize a native scanner with the stream node of its tree */
+static int native_init(struct native* s, struct eyamlopts const* opts, struct pool* pool) {
+    s->lastdoc = NULL;
+    s->doc = NULL;
+    s->pending = NULL;
+    s->depth = 0;
+    tree_init(&s->tree, opts);
+    s->tree.pool = pool;
+    s->stream = tree_node(&s->tree);
+    if (NULL == s->stream)
+        return s->tree.err;
+    s->stream->events[0].type = YAML_STREAM_START_EVENT;
+    s->stream->events[0].data.stream_start.encoding = YAML_UTF8_ENCODING;
+    return 0;
+}
+
+/* Parse a YAML document held in memory with the native scanner */
+static int native_parse(struct eyaml** dest, char const* str, size_t len, struct eyamlopts const* opts, struct pool* pool) {
+    *dest = NULL;
+    struct native s;
+    s.end = str + len;
+    int err = native_init(&s, opts, pool);
+    if (err)
+        return err;
+    err = native_stream(&s, str);
+    if (err) {
+        tree_free(&s.tree);
+        return err;
+    }
+    s.stream->events[1].type = YAML_STREAM_END_EVENT;
+    *dest = s.stream;
+    return 0;
+}
+
+/* Parse a YAML document held in memory with the native scanner only */
+int eyaml_parse_native(struct eyaml** dest, char const* str, size_t len) {
+    return native_parse(dest, str, len, NULL, NULL);
+}
+
+/* --------------------------------------------------------------------- */
+/* -------------------------- JSON fast path --------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* The JSON parser builds the same nodes and events that libyaml builds
+   for a JSON text: flow collections, double-quoted strings and plain
+   numbers and literals. Inputs that are not strict JSON or that libyaml
+   would reject, as invalid characters, long keys or surrogate escapes,
+   make it give up with EYAML_UNSUPPORTED. */
+
+/* Maximum nesting handled by the JSON parser */
+#define JSON_MAXDEPTH 256
+
+/* State of the JSON parser */
+struct json {
+    char const* p;
+    char const* end;
+    int depth;
+    struct tree tree; /* Nodes of the tree being built */
+};
+
+/* Skip the blanks between JSON tokens, tabs are valid only in flow context */
+static void json_spaces(struct json* s, int tabs) {
+    while (s->p < s->end && (' ' == *s->p || '\n' == *s->p || '\r' == *s->p || (tabs && '\t' == *s->p)))
+        ++s->p;
+}
+
+/* Get the length of an UTF-8 sequence of a character that libyaml accepts
+   inside a single-line scalar, zero if it is not valid or it is a line break */
+static int utf8len(unsigned char const* p, unsigned char const* end) {
+    unsigned cp;
+    int len;
+    if (p[0] < 0x80)
+        return 1;
+    else if (0xC0 == (p[0] & 0xE0)) {
+        cp = p[0] & 0x1F;
+        len = 2;
+    }
+    else if (0xE0 == (p[0] & 0xF0)) {
+        cp = p[0] & 0x0F;
+        len = 3;
+    }
+    else if (0xF0 == (p[0] & 0xF8)) {
+        cp = p[0] & 0x07;
+        len = 4;
+    }
+    else
+        return 0;
+    if (end - p < len)
+        return 0;
+    for(int i = 1; i < len; ++i) {
+        if (0x80 != (p[i] & 0xC0))
+            return 0;
+        cp = cp << 6 | (p[i] & 0x3F);
+    }
+    static unsigned const minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (cp < minimum[len] || cp > 0x10FFFF)
+        return 0;
+    int const printable = ((cp >= 0xA0 && cp <= 0xD7FF) || (cp >= 0xE000 && cp <= 0xFFFD) ||
+        cp >= 0x10000) && 0x2028 != cp && 0x2029 != cp;
+    return printable ? len : 0;
+}
+
+/* Encode a code point in UTF-8 */
+static int utf8encode(yaml_char_t* dest, unsigned cp) {
+    if (cp < 0x80) {
+        dest[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        dest[0] = 0xC0 | cp >> 6;
+        dest[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dest[0] = 0xE0 | cp >> 12;
+        dest[1] = 0x80 | (cp >> 6 & 0x3F);
+        dest[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    dest[0] = 0xF0 | cp >> 18;
+    dest[1] = 0x80 | (cp >> 12 & 0x3F);
+    dest[2] = 0x80 | (cp >> 6 & 0x3F);
+    dest[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+/* Parse the four hexadecimal digits of an \u escape */
+static int json_hex(char const* p, unsigned* cp) {
+    *cp = 0;
+    for(int i = 0; i < 4; ++i) {
+        char const c = p[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return EYAML_UNSUPPORTED;
+        *cp = *cp << 4 | digit;
+    }
+    return 0;
+}
+
+/* Parse a string as a double-quoted scalar */
+static int json_string(struct json* s, yaml_event_t* event) {
+    char const* const start = ++s->p;
+    char const* p = start;
+    int escaped = 0;
+    for(;;) {
+        p = nextspecial(p, s->end);
+        if (p >= s->end)
+            return EYAML_UNSUPPORTED;
+        unsigned char const c = *p;
+        if ('"' == c)
+            break;
+        if ('\\' == c) {
+            escaped = 1;
+            p += 2;
+        }
+        else if (c >= 0x80) {
+            int const len = utf8len((unsigned char const*)p, (unsigned char const*)s->end);
+            if (0 == len)
+                return EYAML_UNSUPPORTED;
+            p += len;
+        }
+        else if (c < 0x20 || 0x7f == c)
+            return EYAML_UNSUPPORTED;
+        else
+            ++p;
+    }
+    s->p = p + 1;
+    int const size = p - start;
+    yaml_char_t* value = malloc(size + 1);
+    if (NULL == value)
+        return -1;
+    int len = 0;
+    if (!escaped) {
+        memcpy(value, start, size);
+        len = size;
+    }
+    else for(char const* i = start; i < p; ++i) {
+        if ('\\' != *i) {
+            value[len++] = *i;
+            continue;
+        }
+        unsigned cp;
+        switch(*++i) {
+            case '"':  cp = '"';  break;
+            case '\\': cp = '\\'; break;
+            case '/':  cp = '/';  break;
+            case 'b':  cp = '\b'; break;
+            case 'f':  cp = '\f'; break;
+            case 'n':  cp = '\n'; break;
+            case 'r':  cp = '\r'; break;
+            case 't':  cp = '\t'; break;
+            case 'u':
+                if (p - i <= 4 || json_hex(i + 1, &cp) || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                    free(value);
+                    return EYAML_UNSUPPORTED;
+                }
+                i += 4;
+                break;
+            default:
+                free(value);
+                return EYAML_UNSUPPORTED;
+        }
+        len += utf8encode(value + len, cp);
+    }
+    value[len] = '\0';
+    int err = tree_scalar(&s->tree, len);
+    if (err) {
+        free(value);
+        return err;
+    }
+    setscalar(event, value, len, YAML_DOUBLE_QUOTED_SCALAR_STYLE);
+    return 0;
+}
+
+/* Check if a byte can follow a JSON number or literal */
+static int json_isdelimiter(struct json const* s, char const* p) {
+    return p >= s->end || NULL != strchr(" \t\r\n,]}", *p);
+}
+
+/* Parse a number or a literal as a plain scalar */
+static int json_plain(struct json* s, yaml_event_t* event) {
+    char const* const start = s->p;
+    char const* p = start;
+    if ('t' == *p || 'f' == *p || 'n' == *p) {
+        static char const* const literals[] = { "true", "false", "null" };
+        int i = 't' == *p ? 0 : 'f' == *p ? 1 : 2;
+        size_t const len = strlen(literals[i]);
+        if (s->end - p < len || memcmp(p, literals[i], len))
+            return EYAML_UNSUPPORTED;
+        p += len;
+    }
+    else {
+        if (p < s->end && '-' == *p)
+            ++p;
+        if (p < s->end && '0' == *p)
+            ++p;
+        else if (p < s->end && *p >= '1' && *p <= '9')
+            while (p < s->end && *p >= '0' && *p <= '9')
+                ++p;
+        else
+            return EYAML_UNSUPPORTED;
+        if (p < s->end && '.' == *p) {
+            if (++p >= s->end || *p < '0' || *p > '9')
+                return EYAML_UNSUPPORTED;
+            while (p < s->end && *p >= '0' && *p <= '9')
+                ++p;
+        }
+        if (p < s->end && ('e' == *p || 'E' == *p)) {
+            ++p;
+            if (p < s->end && ('+' == *p || '-' == *p))
+                ++p;
+            if (p >= s->end || *p < '0' || *p > '9')
+                return EYAML_UNSUPPORTED;
+            while (p < s->end && *p >= '0' && *p <= '9')
+                ++p;
+        }
+    }
+    if (!json_isdelimiter(s, p))
+        return EYAML_UNSUPPORTED;
+    s->p = p;
+    return native_scalar(&s->tree, event, start, p - start, YAML_PLAIN_SCALAR_STYLE);
+}
+
+static int json_value(struct json* s, struct eyaml* node, int slot);
+
+/* Parse an object as a flow mapping */
+static int json_object(struct json* s, struct eyaml* node, int slot) {
+    native_collection(node->events + slot, YAML_MAPPING_START_EVENT, 1);
+    native_collection(node->events + slot + 1, YAML_MAPPING_END_EVENT, 1);
+    ++s->p;
+    json_spaces(s, 1);
+    if (s->p < s->end && '}' == *s->p) {
+        ++s->p;
+        return 0;
+    }
+    struct eyaml* last = NULL;
+    for(;;) {
+        if (s->p >= s->end || '"' != *s->p)
+            return EYAML_UNSUPPORTED;
+        struct eyaml* key = tree_node(&s->tree);
+        if (NULL == key)
+            return s->tree.err;
+        if (NULL == last)
+            node->child = key;
+        else
+            last->sibling = key;
+        last = key;
+        char const* const start = s->p;
+        int err = json_string(s, key->events);
+        if (err)
+            return err;
+        /* libyaml wants the colon in the same line and near the key */
+        while (s->p < s->end && (' ' == *s->p || '\t' == *s->p))
+            ++s->p;
+        if (s->p >= s->end || ':' != *s->p || s->p - start >= NATIVE_MAXKEY)
+            return EYAML_UNSUPPORTED;
+        ++s->p;
+        json_spaces(s, 1);
+        err = json_value(s, key, 1);
+        if (err)
+            return err;
+        json_spaces(s, 1);
+        if (s->p >= s->end)
+            return EYAML_UNSUPPORTED;
+        if ('}' == *s->p)
+            break;
+        if (',' != *s->p)
+            return EYAML_UNSUPPORTED;
+        ++s->p;
+        json_spaces(s, 1);
+    }
+    ++s->p;
+    return 0;
+}
+
+/* Parse an array as a flow sequence */
+static int json_array(struct json* s, struct eyaml* node, int slot) {
+    native_collection(node->events + slot, YAML_SEQUENCE_START_EVENT, 1);
+    native_collection(node->events + slot + 1, YAML_SEQUENCE_END_EVENT, 1);
+    ++s->p;
+    json_spaces(s, 1);
+    if (s->p < s->end && ']' == *s->p) {
+        ++s->p;
+        return 0;
+    }
+    struct eyaml* last = NULL;
+    for(;;) {
+        struct eyaml* item = tree_node(&s->tree);
+        if (NULL == item)
+            return s->tree.err;
+        if (NULL == last)
+            node->child = item;
+        else
+            last->sibling = item;
+        last = item;
+        int err = json_value(s, item, 0);
+        if (err)
+            return err;
+        json_spaces(s, 1);
+        if (s->p >= s->end)
+            return EYAML_UNSUPPORTED;
+        if (']' == *s->p)
+            break;
+        if (',' != *s->p)
+            return EYAML_UNSUPPORTED;
+        ++s->p;
+        json_spaces(s, 1);
+    }
+    ++s->p;
+    return 0;
+}
+
+/* Parse a JSON value as the value of a node */
+static int json_value(struct json* s, struct eyaml* node, int slot) {
+    if (s->p >= s->end)
+        return EYAML_UNSUPPORTED;
+    switch(*s->p) {
+        case '"':
+            return json_string(s, node->events + slot);
+        case '{':
+        case '[': {
+            int err = tree_depth(&s->tree, s->depth + 1);
+            if (err)
+                return err;
+            if (JSON_MAXDEPTH == s->depth)
+                return EYAML_UNSUPPORTED;
+            ++s->depth;
+            err = '{' == *s->p ? json_object(s, node, slot) : json_array(s, node, slot);
+            --s->depth;
+            return err;
+        }
+        default:
+            return json_plain(s, node->events + slot);
+    }
+}
+
+/* Parse a JSON text held in memory with the JSON parser */
+static int json_parse(struct eyaml** dest, char const* str, size_t len, struct eyamlopts const* opts, struct pool* pool) {
+    *dest = NULL;
+    struct json s = { .p = str, .end = str + len, .depth = 0 };
+    json_spaces(&s, 0);
+    if (s.p >= s.end || ('{' != *s.p && '[' != *s.p))
+        return EYAML_UNSUPPORTED;
+    tree_init(&s.tree, opts);
+    s.tree.pool = pool;
+    int err = tree_document(&s.tree);
+    if (err)
+        return err;
+    struct eyaml* stream = tree_node(&s.tree);
+    struct eyaml* doc = tree_node(&s.tree);
+    struct eyaml* root = tree_node(&s.tree);
+    if (NULL == stream || NULL == doc || NULL == root) {
+        err = s.tree.err;
+        goto error;
+    }
+    stream->events[0].type = YAML_STREAM_START_EVENT;
+    stream->events[0].data.stream_start.encoding = YAML_UTF8_ENCODING;
+    stream->child = doc;
+    doc->events[0].type = YAML_DOCUMENT_START_EVENT;
+    doc->events[0].data.document_start.implicit = 1;
+    doc->child = root;
+    err = json_value(&s, root, 0);
+    if (err)
+        goto error;
+    json_spaces(&s, 0);
+    if (s.p < s.end) {
+        err = EYAML_UNSUPPORTED;
+        goto error;
+    }
+    doc->events[1].type = YAML_DOCUMENT_END_EVENT;
+    doc->events[1].data.document_end.implicit = 1;
+    stream->events[1].type = YAML_STREAM_END_EVENT;
+    *dest = stream;
+    return 0;
+
+  error:
+    tree_free(&s.tree);
+    return err;
+}
+
+/* Parse a JSON text held in memory with the JSON parser only */
+int eyaml_parse_json(struct eyaml** dest, char const* str, size_t len) {
+    return json_parse(dest, str, len, NULL, NULL);
+}
+
+/* Check if a plain scalar is a JSON number */
+static int json_isnumber(char const* p, char const* end) {
+    if (p < end && '-' == *p)
+        ++p;
+    if (p >= end || *p < '0' || *p > '9')
+        return 0;
+    if ('0' == *p)
+        ++p;
+    else while (p < end && *p >= '0' && *p <= '9')
+        ++p;
+    if (p < end && '.' == *p) {
+        if (++p >= end || *p < '0' || *p > '9')
+            return 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            ++p;
+    }
+    if (p < end && ('e' == *p || 'E' == *p)) {
+        if (++p < end && ('+' == *p || '-' == *p))
+            ++p;
+        if (p >= end || *p < '0' || *p > '9')
+            return 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            ++p;
+    }
+    return p == end;
+}
+
+/* Get the JSON text of an untagged plain scalar that is not a string,
+   null if it has to be written as a string. Nulls and booleans follow the
+   YAML 1.2 core schema, numbers must already be JSON numbers */
+static char const* json_literal(yaml_event_t const* event) {
+    if (YAML_PLAIN_SCALAR_STYLE != event->data.scalar.style || !event->data.scalar.plain_implicit)
+        return NULL;
+    char const* value = (char const*)event->data.scalar.value;
+    size_t const len = event->data.scalar.length;
+    static char const* const nulls[] = { "", "~", "null", "Null", "NULL" };
+    for(int i = 0; i < arraylen(nulls); ++i)
+        if (0 == strcmp(value, nulls[i]))
+            return "null";
+    static char const* const trues[] = { "true", "True", "TRUE" };
+    static char const* const falses[] = { "false", "False", "FALSE" };
+    for(int i = 0; i < arraylen(trues); ++i) {
+        if (0 == strcmp(value, trues[i]))
+            return "true";
+        if (0 == strcmp(value, falses[i]))
+            return "false";
+    }
+    return json_isnumber(value, value + len) ? value : NULL;
+}
+
+/* Write a scalar as a JSON string */
+static void json_emitstring(yaml_event_t const* event, FILE* strm) {
+    char const* p = (char const*)event->data.scalar.value;
+    char const* const end = p + event->data.scalar.length;
+    putc('"', strm);
+    while (p < end) {
+        char const* run = p;
+        while (p < end && '"' != *p && '\\' != *p && (unsigned char)*p >= 0x20)
+            ++p;
+        fwrite(run, 1, p - run, strm);
+        if (p >= end)
+            break;
+        unsigned char const c = *p++;
+        switch(c) {
+            case '"':  fputs("\\\"", strm); break;
+            case '\\': fputs("\\\\", strm); break;
+            case '\b': fputs("\\b", strm);  break;
+            case '\f': fputs("\\f", strm);  break;
+            case '\n': fputs("\\n", strm);  break;
+            case '\r': fputs("\\r", strm);  break;
+            case '\t': fputs("\\t", strm);  break;
+            default:   fprintf(strm, "\\u%04x", c); break;
+        }
+    }
+    putc('"', strm);
+}
+
+/* Get the event of the value of a node, the one after its key if it has one */
+static yaml_event_t const* json_valueof(struct eyaml const* node) {
+    int const haskey = YAML_SCALAR_EVENT == node->events[0].type && YAML_NO_EVENT != node->events[1].type;
+    return node->events + haskey;
+}
+
+/* Write the key of a node if it has one, it is a member of a mapping */
+static void json_emitkey(struct eyaml const* node, FILE* strm) {
+    if (json_valueof(node) == node->events)
+        return;
+    json_emitstring(node->events, strm);
+    putc(':', strm);
+}
+
+/* Write the value of a node as JSON. The open collections are kept in a
+   stack instead of recursing, so any nesting depth can be written.
+   Return non-zero on error */
+static int json_emitvalue(struct eyaml const* node, FILE* strm) {
+    struct stack parents; /* Collections whose children are being written */
+    stack_init(&parents);
+    for(;;) {
+        yaml_event_t const* event = json_valueof(node);
+        if (YAML_SCALAR_EVENT == event->type) {
+            char const* literal = json_literal(event);
+            if (NULL != literal)
+                fputs(literal, strm);
+            else
+                json_emitstring(event, strm);
+        }
+        else if (YAML_MAPPING_START_EVENT == event->type || YAML_SEQUENCE_START_EVENT == event->type) {
+            int const ismap = YAML_MAPPING_START_EVENT == event->type;
+            putc(ismap ? '{' : '[', strm);
+            if (NULL != node->child) {
+                if (stack_push(&parents, (void*)node)) {
+                    stack_flush(&parents);
+                    return -1;
+                }
+                node = node->child;
+                json_emitkey(node, strm);
+                continue;
+            }
+            putc(ismap ? '}' : ']', strm);
+        }
+        else
+            fputs("null", strm);
+        /* Go to the next sibling, closing the collections that are done */
+        for(;;) {
+            struct eyaml const* parent = stack_pick(&parents);
+            if (NULL == parent) {
+                stack_flush(&parents);
+                return 0;
+            }
+            if (NULL != node->sibling) {
+                putc(',', strm);
+                node = node->sibling;
+                json_emitkey(node, strm);
+                break;
+            }
+            stack_pop(&parents);
+            putc(YAML_MAPPING_START_EVENT == json_valueof(parent)->type ? '}' : ']', strm);
+            node = parent;
+        }
+    }
+}
+
+/* Dump a tree of easy-yaml nodes to a stream as compact JSON */
+int eyaml_emit_json(struct eyaml* self, FILE* strm) {
+    if (NULL == self)
+        return 0;
+    if (istype(self, YAML_STREAM_START_EVENT, YAML_STREAM_END_EVENT, YAML_NO_EVENT)) {
+        for(struct eyaml const* doc = self->child; NULL != doc; doc = doc->sibling) {
+            if (json_emitvalue(doc->child, strm))
+                return -1;
+            putc('\n', strm);
+        }
+    }
+    else if (istype(self, YAML_DOCUMENT_START_EVENT, YAML_DOCUMENT_END_EVENT, YAML_NO_EVENT)) {
+        if (json_emitvalue(self->child, strm))
+            return -1;
+        putc('\n', strm);
+    }
+    else if (json_emitvalue(self, strm))
+        return -1;
+    return ferror(strm) ? -1 : 0;
+}
+
+/* Parse a text held in memory with the fastest parser that supports it.
+   A pool may be given */
+static int string_parse(struct eyaml** dest, char const* str, size_t len, struct eyamlopts const* opts, struct pool* pool) {
+    *dest = NULL;
+    if (NULL != opts && overlimit(len, opts->maxbytes))
+        return EYAML_EBYTES;
+    char const* p = str;
+    while (p < str + len && (' ' == *p || '\n' == *p || '\r' == *p))
+        ++p;
+    int err = EYAML_UNSUPPORTED;
+    if (p < str + len && ('{' == *p || '[' == *p))
+        err = json_parse(dest, str, len, opts, pool);
+    if (EYAML_UNSUPPORTED == err)
+        err = native_parse(dest, str, len, opts, pool);
+    if (EYAML_UNSUPPORTED != err)
+        return err;
+    yaml_parser_t parser;
+    if (!yaml_parser_initialize(&parser))
+        return -1;
+    yaml_parser_set_input_string(&parser, (unsigned char const*)str, len);
+    err = parse(dest, &parser, opts, pool);
+    yaml_parser_delete(&parser);
+    return err;
+}
+
+/* Parse a YAML document held in memory */
+int eyaml_parse_string(struct eyaml** dest, char const* str, size_t len) {
+    return eyaml_parse_string_opts(dest, str, len, NULL);
+}
+
+/* Parse a YAML document held in memory within some resource limits */
+int eyaml_parse_string_opts(struct eyaml** dest, char const* str, size_t len, struct eyamlopts const* opts) {
+    return string_parse(dest, str, len, opts, NULL);
+}
+
+/* --------------------------------------------------------------------- */
+/* --------------------------- Parser context -------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* A parser context keeps the memory of a parse for the next one: the
+   chunks of the tree, which the context owns, and the items of the stack
+   of the parse. The LIBYAML parser is not kept. LIBYAML has no function to
+   reset a parser and its private fields are not part of its API, so each
+   parse that needs it initializes a new one. */
+
+struct eyamlparser {
+    struct pool pool;
+    struct eyaml* root;      /* The tree of the last parse            */
+    struct eyamlopts limits;
+    int haslimits;
+};
+
+/* Create a parser context */
+struct eyamlparser* eyaml_parser_create(struct eyamlopts const* opts) {
+    struct eyamlparser* self = malloc(sizeof *self);
+    if (NULL == self)
+        return NULL;
+    self->pool.chunks = NULL;
+    self->pool.items = NULL;
+    self->root = NULL;
+    self->haslimits = NULL != opts;
+    if (self->haslimits)
+        self->limits = *opts;
+    return self;
+}
+
+/* Parse a YAML document held in memory with a parser context */
+int eyaml_parser_parse(struct eyamlparser* self, struct eyaml** dest, char const* str, size_t len) {
+    eyaml_parser_reset(self);
+    int const err = string_parse(dest, str, len, self->haslimits ? &self->limits : NULL, &self->pool);
+    self->root = *dest;
+    return err;
+}
+
+/* Free the tree of the last parse keeping its memory */
+void eyaml_parser_reset(struct eyamlparser* self) {
+    if (NULL == self->root)
+        return;
+    chunks_recycle((struct chunk*)((char*)self->root - offsetof(struct chunk, nodes)), &self->pool);
+    self->root = NULL;
+}
+
+/* Free a parser context and the tree of its last parse */
+void eyaml_parser_destroy(struct eyamlparser* self) {
+    if (NULL == self)
+        return;
+    eyaml_parser_reset(self);
+    chunks_free(self->pool.chunks);
+    while (NULL != self->pool.items) {
+        struct item* item = self->pool.items;
+        self->pool.items = item->down;
+        free(item);
+    }
+    free(self);
+}
+
+/* --------------------------------------------------------------------- */
+/* ---------------------------- Push parser ---------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* The push parser splits the stream in documents by its lines. A document
+   ends where a line starts with a '---' or after a line that starts with a
+   '...', markers that YAML does not allow inside any scalar. The native
+   scanner keeps its state between lines, so it builds the tree of the
+   document being received with the complete lines of each call. LIBYAML
+   pulls its input and can not be suspended, so the text of the document
+   is also kept until it is complete: if a line is out of the native subset
+   the partial tree is dropped and LIBYAML parses the whole text. The nodes
+   of each complete document are moved into the tree of the whole stream,
+   which persists between calls. */
+
+/* State of the split of a stream in documents at the start of a line */
+struct split {
+    int content;   /* The current segment has content or a '---' */
+    int directive; /* The current segment has directives */
+    int ended;     /* The last document was closed by a '...' */
+};
+
+/* What a line does to the split of a stream in documents */
+enum cut {
+    CUT_NONE,   /* The line belongs to the current segment */
+    CUT_BEFORE, /* A document ends before the line, which starts the next segment */
+    CUT_AFTER,  /* A document ends after the line, a '...' */
+    CUT_SKIP,   /* The line is a repeated '...', the next segment starts after it */
+    CUT_ERROR   /* The line is not valid there */
+};
+
+/* Check if a line is a document marker as '---' or '...'. The line ends
+   at 'end', which may be its line feed or the end of the file */
+static int split_ismarker(char const* line, char const* end, char c) {
+    return end - line >= 3 && c == line[0] && c == line[1] && c == line[2]
+        && (end - line == 3 || NULL != strchr(" \t\r\n", line[3]));
+}
+
+/* Split a stream at a line, which ends at 'end', its line feed or the end
+   of the file. As LIBYAML, a '...' needs a document before it, except
+   that repeated ones are skipped, and after a '...' or a directive only
+   a '---' may start a document */
+static enum cut split_line(struct split* self, char const* line, char const* end) {
+    if (split_ismarker(line, end, '-')) {
+        enum cut const cut = self->content ? CUT_BEFORE : CUT_NONE;
+        if (CUT_BEFORE == cut)
+            self->directive = 0;
+        self->content = 1;
+        self->ended = 0;
+        return cut;
+    }
+    if (split_ismarker(line, end, '.')) {
+        enum cut cut = CUT_ERROR;
+        if (self->content)
+            cut = CUT_AFTER;
+        else if (self->ended && !self->directive)
+            cut = CUT_SKIP;
+        self->content = 0;
+        self->directive = 0;
+        self->ended = 1;
+        return cut;
+    }
+    if (self->content)
+        return CUT_NONE;
+    if ('%' == *line) {
+        self->directive = 1;
+        return CUT_NONE;
+    }
+    char const* p = line;
+    while (p < end && (' ' == *p || '\t' == *p || '\r' == *p))
+        ++p;
+    if (p == end || '#' == *p)
+        return CUT_NONE;
+    if (self->ended || self->directive)
+        return CUT_ERROR;
+    self->content = 1;
+    return CUT_NONE;
+}
+
+/* States of the native scan of the document being received */
+enum scan { SCAN_IDLE, SCAN_ACTIVE, SCAN_DROPPED };
+
+/* Holds a push parser */
+struct eyamlpush {
+    struct tree tree;      /* Tree of the stream, its root is the first node */
+    struct eyaml* lastdoc; /* Last document appended to the stream */
+    char* buff;            /* Text not parsed yet */
+    size_t len;            /* Number of bytes in the buffer */
+    size_t size;           /* Capacity of the buffer */
+    size_t scanned;        /* Start of the first line not scanned yet */
+    size_t fed;            /* Number of bytes fed */
+    struct split split;    /* Split state of the text in the buffer */
+    int err;               /* Error that stopped the parser, zero if none */
+    enum scan scan;        /* State of the native scan of the buffer */
+    size_t nativepos;      /* Start of the first line not scanned natively */
+    struct native native;  /* Native scanner of the text in the buffer */
+};
+
+/* Create a push parser */
+struct eyamlpush* eyaml_push_create(struct eyamlopts const* opts) {
+    struct eyamlpush* self = malloc(sizeof *self);
+    if (NULL == self)
+        return NULL;
+    memset(self, 0, sizeof *self);
+    tree_init(&self->tree, opts);
+    struct eyaml* stream = tree_node(&self->tree);
+    if (NULL == stream) {
+        free(self);
+        return NULL;
+    }
+    stream->events[0].type = YAML_STREAM_START_EVENT;
+    stream->events[0].data.stream_start.encoding = YAML_UTF8_ENCODING;
+    return self;
+}
+
+/* Free a push parser and the tree it holds if it was not finished */
+void eyaml_push_destroy(struct eyamlpush* self) {
+    if (NULL == self)
+        return;
+    if (SCAN_ACTIVE == self->scan)
+        tree_free(&self->native.tree);
+    tree_free(&self->tree);
+    free(self->buff);
+    free(self);
+}
+
+/* Get the stream node of the documents parsed so far */
+struct eyaml* eyaml_push_root(struct eyamlpush* self) {
+    return NULL == self->tree.first ? NULL : self->tree.first->nodes;
+}
+
+/* Get the limits for the parse of the text in the buffer */
+static void push_limits(struct eyamlpush const* self, struct eyamlopts* opts) {
+    *opts = self->tree.limits;
+    opts->maxbytes = 0; /* Checked as the bytes are fed */
+    opts->maxdocs = 0;  /* Checked by push_parse() */
+    if (0 != opts->maxnodes)
+        opts->maxnodes = opts->maxnodes - self->tree.nodes + 1; /* Plus its stream node */
+}
+
+/* Leave the text in the buffer to LIBYAML dropping its partial tree */
+static void push_drop(struct eyamlpush* self) {
+    if (SCAN_ACTIVE == self->scan)
+        tree_free(&self->native.tree);
+    self->scan = SCAN_DROPPED;
+}
+
+/* Scan natively the lines of the buffer up to 'len', which is the end of a line */
+static int push_scan(struct eyamlpush* self, size_t len) {
+    if (SCAN_DROPPED == self->scan || self->nativepos == len)
+        return 0;
+    struct native* s = &self->native;
+    if (SCAN_IDLE == self->scan) {
+        struct eyamlopts opts;
+        push_limits(self, &opts);
+        if (native_init(s, &opts, NULL)) {
+            tree_free(&s->tree);
+            self->scan = SCAN_DROPPED;
+            return 0;
+        }
+        self->scan = SCAN_ACTIVE;
+    }
+    s->end = self->buff + len;
+    int err = native_lines(s, self->buff + self->nativepos);
+    self->nativepos = len;
+    if (EYAML_UNSUPPORTED == err)
+        push_drop(self);
+    else if (err)
+        return err;
+    return 0;
+}
+
+/* Parse the first bytes of the buffer and append their documents to the stream */
+static int push_parse(struct eyamlpush* self, size_t len) {
+    int err = push_scan(self, len);
+    if (err)
+        return err;
+    if (SCAN_ACTIVE == self->scan && NULL != self->native.doc) {
+        err = native_docend(&self->native, 1);
+        if (EYAML_UNSUPPORTED == err)
+            push_drop(self);
+        else if (err)
+            return err;
+    }
+    struct eyaml* root;
+    if (SCAN_ACTIVE == self->scan)
+        root = self->native.stream;
+    else {
+        struct eyamlopts opts;
+        push_limits(self, &opts);
+        err = eyaml_parse_string_opts(&root, self->buff, len, &opts);
+        if (err)
+            return err < 0 ? err : -1;
+    }
+    self->scan = SCAN_IDLE;
+    self->nativepos = 0;
+    int docs = 0;
+    for(struct eyaml* doc = root->child; NULL != doc; doc = doc->sibling) {
+        struct eyaml* stream = eyaml_push_root(self);
+        if (NULL == self->lastdoc)
+            stream->child = doc;
+        else
+            self->lastdoc->sibling = doc;
+        self->lastdoc = doc;
+        ++docs;
+    }
+    root->child = NULL;
+    tree_adopt(&self->tree, root);
+    --self->tree.nodes; /* The stream node of the parsed text is not used */
+    self->tree.docs += docs;
+    memmove(self->buff, self->buff + len, self->len - len);
+    self->len -= len;
+    self->scanned -= len;
+    if (overlimit(self->tree.docs, self->tree.limits.maxdocs))
+        return EYAML_EDOCS;
+    return 0 < docs ? EYAML_DOCREADY : EYAML_NEEDMORE;
+}
+
+/* Split the stream at a line of the buffer, which starts at 'start' and
+   ends at 'end', its line feed or the end of the stream */
+static int push_line(struct eyamlpush* self, size_t start, char const* end) {
+    switch(split_line(&self->split, self->buff + start, end)) {
+        case CUT_BEFORE:
+            return push_parse(self, start);
+        case CUT_AFTER:
+            return push_parse(self, self->scanned);
+        case CUT_SKIP: /* Only blanks, comments and the marker were scanned */
+            memmove(self->buff, self->buff + self->scanned, self->len - self->scanned);
+            self->len -= self->scanned;
+            self->scanned = 0;
+            self->nativepos = 0;
+            if (SCAN_DROPPED == self->scan)
+                self->scan = SCAN_IDLE;
+            return EYAML_NEEDMORE;
+        case CUT_ERROR:
+            return -1;
+        default:
+            return EYAML_NEEDMORE;
+    }
+}
+
+/* Feed a push parser with the next bytes of a YAML stream */
+int eyaml_feed(struct eyamlpush* self, char const* chunk, size_t len) {
+    if (self->err)
+        return self->err;
+    self->fed += len;
+    if (overlimit(self->fed, self->tree.limits.maxbytes))
+        return self->err = EYAML_EBYTES;
+    if (self->len + len > self->size) {
+        size_t size = 0 == self->size ? 4096 : self->size;
+        while (size < self->len + len)
+            size *= 2;
+        char* buff = realloc(self->buff, size);
+        if (NULL == buff)
+            return self->err = -1;
+        self->buff = buff;
+        self->size = size;
+    }
+    memcpy(self->buff + self->len, chunk, len);
+    self->len += len;
+    int rslt = EYAML_NEEDMORE;
+    for(;;) {
+        char const* const line = self->buff + self->scanned;
+        char const* const end = self->buff + self->len;
+        char const* eol = memchr(line, '\n', end - line);
+        if (NULL == eol)
+            break;
+        size_t const start = self->scanned;
+        self->scanned = eol + 1 - self->buff;
+        int err = push_line(self, start, eol);
+        if (err < 0)
+            return self->err = err;
+        if (EYAML_DOCREADY == err)
+            rslt = err;
+    }
+    int err = push_scan(self, self->scanned);
+    if (err)
+        return self->err = err;
+    return rslt;
+}
+
+/* Parse the rest of the stream and get the tree of the whole stream */
+int eyaml_finish(struct eyamlpush* self, struct eyaml** root) {
+    *root = NULL;
+    if (self->err)
+        return self->err;
+    int err = 0;
+    if (self->scanned < self->len) { /* A last line without a line feed */
+        size_t const start = self->scanned;
+        self->scanned = self->len;
+        err = push_line(self, start, self->buff + self->len);
+    }
+    if (0 <= err && 0 < self->len)
+        err = push_parse(self, self->len);
+    if (err < 0)
+        return self->err = err;
+    struct eyaml* stream = eyaml_push_root(self);
+    stream->events[1].type = YAML_STREAM_END_EVENT;
+    *root = stream;
+    memset(&self->tree, 0, sizeof self->tree); /* The caller owns the tree now */
+    self->err = -1;
+    return 0;
+}
+
+/* --------------------------------------------------------------------- */
+/* --------------------------- Document index -------------------------- */
+/* --------------------------------------------------------------------- */
+
+/* The document index splits a file with split_line() as the push parser
+   does: a document starts at a '---' line that follows content, or at the
+   text after a '...' line or the start of the file if it has content or a
+   '---' line. A file that the split rejects is not indexed. The index
+   keeps the scan state at the start of the last line, which may be
+   incomplete, so an update only scans that line and the appended bytes.
+   The files are mapped in memory to scan and parse. */
+
+/* Scan state of a document index at the start of a line */
+struct docscan {
+    uint64_t segment;   /* Start of the text of the current document       */
+    int count;          /* Documents found                                 */
+    struct split split; /* Split state of the current segment              */
+};
+
+struct eyamldocindex {
+    struct docscan scan; /* State at 'resume'                                */
+    uint64_t resume;     /* Start of the last line, every line before it ends */
+    uint64_t size;       /* Bytes of the file that were scanned              */
+    int count;           /* Documents, including one started in the last line */
+    int capacity;        /* Capacity of the offsets array                     */
+    uint64_t* offsets;   /* Start of each document in the file                */
+};
+
+/* Header of a saved document index, followed by the offsets */
+struct docheader {
+    char magic[8];
+    uint64_t resume;
+    uint64_t size;
+    uint64_t segment;
+    int32_t scancount;
+    int32_t content;
+    int32_t directive;
+    int32_t ended;
+    int32_t count;
+};
+
+static char const docmagic[8] = "EYAMLDX1";
+
+/* A mapped span of a file */
+struct span {
+    void* addr;
+    size_t len;
+    char const* text;   /* The first byte of the span */
+};
+
+/* Map a span of a file in memory, the offset does not need to be aligned */
+static int span_map(struct span* self, int fd, uint64_t start, uint64_t end) {
+    uint64_t const page = sysconf(_SC_PAGESIZE);
+    uint64_t const aligned = start - start % page;
+    self->len = end - aligned;
+    self->addr = mmap(NULL, self->len, PROT_READ, MAP_PRIVATE, fd, aligned);
+    if (MAP_FAILED == self->addr)
+        return -1;
+    self->text = (char const*)self->addr + (start - aligned);
+    return 0;
+}
+
+/* Scan a line. 'end' points to its line feed or to the end of the file.
+   Return negative on error, positive if the line is not valid there */
+static int docs_line(struct eyamldocindex* self, struct docscan* scan, char const* line, char const* end, uint64_t offset) {
+    if (scan->count == self->capacity) {
+        int const capacity = self->capacity ? 2 * self->capacity : 64;
+        uint64_t* offsets = realloc(self->offsets, capacity * sizeof *offsets);
+        if (NULL == offsets)
+            return -1;
+        self->offsets = offsets;
+        self->capacity = capacity;
+    }
+    int const content = scan->split.content;
+    enum cut const cut = split_line(&scan->split, line, end);
+    if (CUT_ERROR == cut)
+        return 1;
+    if (CUT_AFTER == cut || CUT_SKIP == cut)
+        scan->segment = offset + (end - line) + 1;
+    else if (CUT_BEFORE == cut || (!content && scan->split.content)) {
+        if (CUT_BEFORE == cut)
+            scan->segment = offset;
+        self->offsets[scan->count++] = scan->segment;
+    }
+    return 0;
+}
+
+/* Index the documents of a file */
+struct eyamldocindex* eyaml_index_documents(char const* path) {
+    struct eyamldocindex* self = calloc(1, sizeof *self);
+    if (NULL == self)
+        return NULL;
+    if (eyaml_docindex_update(self, path)) {
+        eyaml_docindex_free(self);
+        return NULL;
+    }
+    return self;
+}
+
+/* Index the documents appended to a file since it was indexed */
+int eyaml_docindex_update(struct eyamldocindex* self, char const* path) {
+    int const fd = open(path, O_RDONLY);
+    if (0 > fd)
+        return -1;
+    struct stat st;
+    int err = fstat(fd, &st);
+    if (err || (uint64_t)st.st_size < self->size) {
+        close(fd);
+        return -1;
+    }
+    uint64_t const size = st.st_size;
+    struct span span = { .addr = NULL };
+    if (size > self->resume && span_map(&span, fd, self->resume, size)) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    char const* line = span.text;
+    char const* const end = line + (size - self->resume);
+    struct docscan last;
+    for(;;) {
+        char const* eol = line < end ? memchr(line, '\n', end - line) : NULL;
+        if (NULL == eol)
+            break;
+        if (docs_line(self, &self->scan, line, eol, self->resume)) {
+            err = -1;
+            break;
+        }
+        self->resume += eol + 1 - line;
+        line = eol + 1;
+    }
+    /* The last line is scanned but the state is kept at its start. It
+       may be incomplete, so it is only checked when a line feed ends it */
+    last = self->scan;
+    if (0 == err && line < end && docs_line(self, &last, line, end, self->resume) < 0)
+        err = -1;
+    if (NULL != span.addr)
+        munmap(span.addr, span.len);
+    self->count = last.count;
+    if (0 == err)
+        self->size = size;
+    return err;
+}
+
+/* Get the number of documents of an index */
+int eyaml_docindex_count(struct eyamldocindex const* self) {
+    return self->count;
+}
+
+/* Save a document index to a file */
+int eyaml_docindex_save(struct eyamldocindex const* self, char const* path) {
+    FILE* file = fopen(path, "wb");
+    if (NULL == file)
+        return -1;
+    struct docheader header = {
+        .resume = self->resume,
+        .size = self->size,
+        .segment = self->scan.segment,
+        .scancount = self->scan.count,
+        .content = self->scan.split.content,
+        .directive = self->scan.split.directive,
+        .ended = self->scan.split.ended,
+        .count = self->count
+    };
+    memcpy(header.magic, docmagic, sizeof header.magic);
+    int err = 1 != fwrite(&header, sizeof header, 1, file);
+    if (!err && self->count)
+        err = (size_t)self->count != fwrite(self->offsets, sizeof *self->offsets, self->count, file);
+    if (fclose(file))
+        err = 1;
+    return err ? -1 : 0;
+}
+
+/* Load a document index saved by eyaml_docindex_save() */
+struct eyamldocindex* eyaml_docindex_load(char const* path) {
+    FILE* file = fopen(path, "rb");
+    if (NULL == file)
+        return NULL;
+    struct docheader header;
+    struct eyamldocindex* self = NULL;
+    if (1 != fread(&header, sizeof header, 1, file) || memcmp(header.magic, docmagic, sizeof header.magic))
+        goto error;
+    if (header.count < header.scancount || header.scancount < 0 || header.resume > header.size)
+        goto error;
+    self = calloc(1, sizeof *self);
+    if (NULL == self)
+        goto error;
+    self->resume = header.resume;
+    self->size = header.size;
+    self->scan.segment = header.segment;
+    self->scan.count = header.scancount;
+    self->scan.split.content = header.content;
+    self->scan.split.directive = header.directive;
+    self->scan.split.ended = header.ended;
+    self->count = header.count;
+    self->capacity = header.count;
+    self->offsets = malloc(header.count * sizeof *self->offsets + 1);
+    if (NULL == self->offsets)
+        goto error;
+    if ((size_t)header.count != fread(self->offsets, sizeof *self->offsets, header.count, file))
+        goto error;
+    fclose(file);
+    return self;
+
+  error:
+    eyaml_docindex_free(self);
+    fclose(file);
+    return NULL;
+}
+
+/* Free a document index */
+void eyaml_docindex_free(struct eyamldocindex* self) {
+    if (NULL == self)
+        return;
+    free(self->offsets);
+    free(self);
+}
+
+/* Parse one document of a file */
+int eyaml_parse_document(struct eyaml** dest, char const* path, struct eyamldocindex const* index, int n) {
+    *dest = NULL;
+    if (0 > n)
+        n += index->count;
+    if (0 > n || n >= index->count)
+        return -1;
+    uint64_t const start = index->offsets[n];
+    uint64_t const end = n + 1 < index->count ? index->offsets[n + 1] : index->size;
+    int const fd = open(path, O_RDONLY);
+    if (0 > fd)
+        return -1;
+    struct span span;
+    int err = span_map(&span, fd, start, end);
+    close(fd);
+    if (err)
+        return -1;
+    err = eyaml_parse_string(dest, span.text, end - start);
+    munmap(span.addr, span.len);
     return err;
 }
 
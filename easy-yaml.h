@@ -30,10 +30,224 @@ enum eyamltype {
   * @return Zero on success, non-zero on error */
 int eyaml_parse(struct eyaml** root, FILE* src);
 
+/** Return code of eyaml_parse_native() for inputs out of its subset and
+  * of eyaml_parse_compressed() for codecs not compiled in. It differs from
+  * the 1 that the parsers return on a syntax error */
+#define EYAML_UNSUPPORTED 4
+
+/** Limits on the resources that parsing an input can take.
+  * Useful for untrusted inputs. A zero field means no limit. */
+struct eyamlopts {
+    size_t maxbytes;  /**< Maximum number of bytes of the input */
+    size_t maxnodes;  /**< Maximum number of nodes of the tree */
+    int    maxdepth;  /**< Maximum nesting of mappings and sequences */
+    size_t maxscalar; /**< Maximum length in bytes of a scalar or a key */
+    int    maxdocs;   /**< Maximum number of documents */
+};
+
+/** Return codes of the parsers when a limit of eyamlopts is exceeded */
+#define EYAML_EBYTES  -100
+#define EYAML_ENODES  -101
+#define EYAML_EDEPTH  -102
+#define EYAML_ESCALAR -103
+#define EYAML_EDOCS   -104
+
+/** Parse a YAML stream within some resource limits
+  * Parsing stops as soon as a limit is exceeded and all the nodes built so
+  * far are released.
+  * @param [out] root Destination easy-yaml handle
+  * @param [in]  src  Source stream
+  * @param [in]  opts Limits, null for none
+  * @return Zero on success, one of EYAML_EBYTES, EYAML_ENODES, EYAML_EDEPTH,
+  *         EYAML_ESCALAR or EYAML_EDOCS on exceeded limit, non-zero on error */
+int eyaml_parse_opts(struct eyaml** root, FILE* src, struct eyamlopts const* opts);
+
+/** Flag of eyaml_parse_compressed() to decode in a second thread */
+#define EYAML_THREADED 1
+
+/** Parse a YAML stream that may be compressed with gzip or zstd
+  * The codec is detected by its magic bytes, other inputs are parsed as
+  * they are. The input is decoded as it is parsed, with no intermediate
+  * file, and the memory taken does not depend on the decoded size.
+  * The gzip codec is compiled in with EYAML_ZLIB and the zstd one with
+  * EYAML_ZSTD. The byte limit of opts applies to the decoded bytes.
+  * @param [out] root  Destination easy-yaml handle
+  * @param [in]  src   Source stream
+  * @param [in]  flags EYAML_THREADED to overlap the decoding and the parsing
+  * @param [in]  opts  Limits, null for none
+  * @return Zero on success, EYAML_UNSUPPORTED if the codec is not compiled
+  *         in, the limit codes as eyaml_parse_opts(), non-zero on error */
+int eyaml_parse_compressed(struct eyaml** root, FILE* src, int flags, struct eyamlopts const* opts);
+
+/** Parse a YAML stream held in memory
+  * JSON texts are parsed by a dedicated JSON parser. Inputs made of block
+  * mappings, block sequences, flow sequences of scalars and single-line
+  * scalars are scanned natively. Any other input is parsed by LIBYAML.
+  * All ways build the same tree.
+  * @param [out] root Destination easy-yaml handle
+  * @param [in]  str  Source buffer, it does not need to be null-terminated
+  * @param [in]  len  Number of bytes of the source buffer
+  * @return Zero on success, non-zero on error */
+int eyaml_parse_string(struct eyaml** root, char const* str, size_t len);
+
+/** Parse a YAML stream held in memory within some resource limits
+  * @param [out] root Destination easy-yaml handle
+  * @param [in]  str  Source buffer, it does not need to be null-terminated
+  * @param [in]  len  Number of bytes of the source buffer
+  * @param [in]  opts Limits, null for none
+  * @return Zero on success, one of the limit codes as eyaml_parse_opts(),
+  *         non-zero on error */
+int eyaml_parse_string_opts(struct eyaml** root, char const* str, size_t len, struct eyamlopts const* opts);
+
+/** Parse a YAML stream held in memory with the native scanner only
+  * @param [out] root Destination easy-yaml handle
+  * @param [in]  str  Source buffer, it does not need to be null-terminated
+  * @param [in]  len  Number of bytes of the source buffer
+  * @return Zero on success, EYAML_UNSUPPORTED if the input needs LIBYAML,
+  *         negative on error */
+int eyaml_parse_native(struct eyaml** root, char const* str, size_t len);
+
+/** Parse a JSON text held in memory with the JSON parser only
+  * @param [out] root Destination easy-yaml handle
+  * @param [in]  str  Source buffer, it does not need to be null-terminated
+  * @param [in]  len  Number of bytes of the source buffer
+  * @return Zero on success, EYAML_UNSUPPORTED if the input needs LIBYAML,
+  *         negative on error */
+int eyaml_parse_json(struct eyaml** root, char const* str, size_t len);
+
+/** Holds a parser context that keeps its memory from a parse to the next */
+struct eyamlparser;
+
+/** Create a parser context, typically one per thread
+  * It keeps warm the nodes of the trees and the stack of the parse, so
+  * parsing many small messages does not allocate them again. It holds the
+  * memory of the biggest message parsed.
+  * @param [in] opts Limits of every parse, may be null
+  * @return The handle of the context, null on error */
+struct eyamlparser* eyaml_parser_create(struct eyamlopts const* opts);
+
+/** Parse a YAML document held in memory as eyaml_parse_string_opts() does
+  * The tree belongs to the context: it is valid until the next parse, reset
+  * or destroy of the context and it must not be freed with eyaml_destroy().
+  * @param [in]  self A parser context
+  * @param [out] root Destination easy-yaml handle
+  * @param [in]  str  Source buffer, it does not need to be null-terminated
+  * @param [in]  len  Number of bytes of the source buffer
+  * @return Zero on success, non-zero on error */
+int eyaml_parser_parse(struct eyamlparser* self, struct eyaml** root, char const* str, size_t len);
+
+/** Free the tree of the last parse, keeping its memory for the next one */
+void eyaml_parser_reset(struct eyamlparser* self);
+
+/** Free a parser context, the tree of its last parse and its memory */
+void eyaml_parser_destroy(struct eyamlparser* self);
+
+/** Holds a push parser, it is fed with the bytes of a stream as they arrive */
+struct eyamlpush;
+
+/** Return codes of eyaml_feed() */
+#define EYAML_NEEDMORE 2 /**< No document was completed, feed more bytes */
+#define EYAML_DOCREADY 3 /**< One or more documents were appended to the stream */
+
+/** Create a push parser
+  * A document is complete when a line that starts with '---' or '...' or
+  * eyaml_finish() ends it, and only then it is appended to the stream.
+  * While it is received, the tree of a document in the native subset of
+  * eyaml_parse_string() grows with each complete line fed, so
+  * eyaml_finish() has little left to do. Its text is buffered until it is
+  * complete all the same, in case a later line needs LIBYAML. Any other
+  * document is fully buffered and parsed when it is complete, which for a
+  * single document means inside eyaml_finish().
+  * @param [in] opts Limits for the whole stream, null for none
+  * @return The handle of the parser, null on error */
+struct eyamlpush* eyaml_push_create(struct eyamlopts const* opts);
+
+/** Feed a push parser with the next bytes of a YAML stream
+  * It never blocks, so a single thread can serve many parsers.
+  * @param [in] self  A push parser
+  * @param [in] chunk The next bytes of the stream
+  * @param [in] len   The number of bytes
+  * @return EYAML_NEEDMORE, EYAML_DOCREADY, negative on error. After an
+  *         error the parser returns it on every call */
+int eyaml_feed(struct eyamlpush* self, char const* chunk, size_t len);
+
+/** Get the stream node with the documents parsed so far
+  * It is valid until the parser is finished or destroyed.
+  * @param [in] self A push parser
+  * @return The root of the tree being built */
+struct eyaml* eyaml_push_root(struct eyamlpush* self);
+
+/** Parse the rest of the stream and get the whole tree
+  * The parser can not be fed anymore, it has to be destroyed.
+  * @param [in]  self A push parser
+  * @param [out] root Destination easy-yaml handle, the caller owns it
+  * @return Zero on success, negative on error */
+int eyaml_finish(struct eyamlpush* self, struct eyaml** root);
+
+/** Free a push parser and the tree being built if it was not finished
+  * @param [in] self A push parser */
+void eyaml_push_destroy(struct eyamlpush* self);
+
+/** Holds the offsets of the documents of a file */
+struct eyamldocindex;
+
+/** Index the documents of a YAML file
+  * The file is split in documents as the push parser does: at '---' lines
+  * that follow content and after '...' lines. Only the lines are scanned,
+  * nothing is parsed. A misplaced marker, as content after a '...' with no
+  * '---' before it, is an error as for eyaml_parse(). The last line is
+  * only checked once a line feed ends it.
+  * @param [in] path The path of the file
+  * @return The index, null on error */
+struct eyamldocindex* eyaml_index_documents(char const* path);
+
+/** Index the documents appended to a file since it was indexed
+  * Only the appended bytes and the last line indexed before are scanned.
+  * @param [in] self A document index
+  * @param [in] path The path of the indexed file
+  * @return Zero on success, non-zero on error or if the file is shorter */
+int eyaml_docindex_update(struct eyamldocindex* self, char const* path);
+
+/** Get the number of documents of an index */
+int eyaml_docindex_count(struct eyamldocindex const* self);
+
+/** Save a document index to a file in the byte order of this machine
+  * @return Zero on success, non-zero on error */
+int eyaml_docindex_save(struct eyamldocindex const* self, char const* path);
+
+/** Load a document index saved by eyaml_docindex_save()
+  * It can be updated as the index it was saved from.
+  * @return The index, null on error */
+struct eyamldocindex* eyaml_docindex_load(char const* path);
+
+/** Free a document index */
+void eyaml_docindex_free(struct eyamldocindex* self);
+
+/** Parse one document of a file without reading the rest of it
+  * The span of the document is mapped in memory and parsed as with
+  * eyaml_parse_string(). Bytes appended after the index was updated
+  * are not read.
+  * @param [out] root  Destination easy-yaml handle, a stream with the document
+  * @param [in]  path  The path of the indexed file
+  * @param [in]  index The index of the file
+  * @param [in]  n     The number of the document, negative to count from the end
+  * @return Zero on success, non-zero on error */
+int eyaml_parse_document(struct eyaml** root, char const* path, struct eyamldocindex const* index, int n);
+
 /** Free a tree of easy-yaml nodes
-  * @param root The root of the tree */
+  * @param root The root of the tree as returned by a parser, not any other node */
 void eyaml_destroy(struct eyaml* root);
 
+/** Free a tree of easy-yaml nodes in a background thread
+  * It returns at once for any size of the tree. The tree must not be used
+  * after the call. If the thread can not be started the tree is freed here.
+  * @param root The root of the tree as returned by a parser, not any other node */
+void eyaml_destroy_async(struct eyaml* root);
+
+/** Wait until every tree given to eyaml_destroy_async() has been freed
+  * Call it before exiting or to measure the memory in use. */
+void eyaml_destroy_drain(void);
+
 /** Search in a mapping member node by its name
   * @param [in] self The easy-yaml parent mapping node where to search
   * @param [in] name The name of the child node to find
@@ -119,6 +333,50 @@ int eyaml_names2values(struct eyaml* self, void* dest, ...);
   * @return Number of fields found */
 int eyaml_values(struct eyaml* self, void* dest, char const* names[]);
 
+/** Holds an index of the elements of a collection by the value of a field */
+struct eyamlindex;
+
+/** Build an index of the elements of a collection by the value of a field
+  * Elements that are not mappings or have not that field with a scalar
+  * value are left out. The index points into the tree, so it must be freed
+  * before eyaml_destroy(); using it afterwards is undefined.
+  * @param [in] self A sequence or mapping node
+  * @param [in] name The name of the field
+  * @return The index, null on error. Free it with eyaml_index_free() */
+struct eyamlindex* eyaml_build_index(struct eyaml* self, char const* name);
+
+/** Find the first element, in document order, whose field has a value
+  * @param [in] self  An index
+  * @param [in] value The value of the field
+  * @return The easy-yaml node of the element on found, null pointer on other cases */
+struct eyaml* eyaml_index_find(struct eyamlindex const* self, char const* value);
+
+/** Get all the elements, in document order, whose field has a value
+  * @param [in]  self  An index
+  * @param [in]  value The value of the field
+  * @param [out] dest  Destination array of easy-yaml nodes
+  * @param [in]  max   Length of the destination array
+  * @return The number of elements found, it can be greater than max */
+int eyaml_index_findall(struct eyamlindex const* self, char const* value, struct eyaml** dest, int max);
+
+/** Check if every element of an index has a different value
+  * @param [in] self An index
+  * @return Non-zero if the values are unique, zero if not or if the index is null */
+int eyaml_index_isunique(struct eyamlindex const* self);
+
+/** Free an index, before the destruction of its tree
+  * @param [in] self An index */
+void eyaml_index_free(struct eyamlindex* self);
+
+/** Copy a subtree into a new standalone tree
+  * The copy is a single allocation with the nodes in depth-first order
+  * followed by their strings, so the source tree can be destroyed and the
+  * copy takes less memory and has better locality. If the node is a
+  * mapping member the copy keeps its name.
+  * @param [in] self The root node of the subtree
+  * @return The root of the new tree, null on error. Free it with eyaml_destroy() */
+struct eyaml* eyaml_extract(struct eyaml* self);
+
 /** Get the type of a node
   * @param [in] self A valid handle of a easy-yaml node
   * @return The type code */
@@ -129,6 +387,83 @@ enum eyamltype eyaml_type(struct eyaml* self);
   * @param [out] dest Destination stream */
 int eyaml_emit(struct eyaml* self, FILE* dest);
 
+/** Dump a tree of easy-yaml nodes to a stream as compact JSON
+  * Untagged plain scalars that are null or booleans in the YAML 1.2 core
+  * schema, or that are JSON numbers, are written as such. Any other scalar
+  * is written as a string, core schema numbers such as 0x1F, +1, .5 or
+  * .inf included.
+  * Each document of a stream is written in its own line.
+  * @param [in]  self The root node of the tree or any node of it
+  * @param [out] dest Destination stream
+  * @return Zero on success, non-zero on error */
+int eyaml_emit_json(struct eyaml* self, FILE* dest);
+
+/** Holds a streaming writer */
+struct eyamlwriter;
+
+/** Receives the text of a writer
+  * @param [in] data The pointer given to eyaml_writer_create()
+  * @param [in] buff The text, it is not null-terminated
+  * @param [in] len  The number of bytes of the text
+  * @return Zero on success, non-zero on error */
+typedef int (*eyamlsink)(void* data, char const* buff, size_t len);
+
+/** Options of a writer, zero means the default */
+struct eyamlwriteropts {
+    size_t buffsize; /**< Bytes sent to the sink in each batch, 64 KiB by default   */
+    int flowseq;     /**< Sequences of up to this number of scalars use flow style */
+};
+
+/** Create a writer that streams YAML to a callback
+  * The writer does not build a tree and its memory does not depend on the
+  * size of the output. The nodes of each document are written in order:
+  * eyaml_writer_begin_map() or eyaml_writer_begin_seq() opens a collection,
+  * eyaml_writer_key() precedes each member of a mapping and eyaml_writer_end()
+  * closes the innermost collection. A document is a mapping or a sequence,
+  * it ends when its root collection is closed and the next one is a new
+  * document. The output parses back with eyaml_parse() into the same tree.
+  * Every call returns zero on success and non-zero on error. A misplaced
+  * call, a null string or an error of the sink is sticky: every later
+  * call fails.
+  * @param [in] sink Callback that receives the text in batches
+  * @param [in] data Pointer passed to the callback
+  * @param [in] opts Options of the writer, may be null
+  * @return The handle of the writer, null on error */
+struct eyamlwriter* eyaml_writer_create(eyamlsink sink, void* data, struct eyamlwriteropts const* opts);
+
+/** Create a writer that streams YAML to a file descriptor
+  * @param [in] fd   The file descriptor, the writer does not close it
+  * @param [in] opts Options of the writer, may be null
+  * @return The handle of the writer, null on error */
+struct eyamlwriter* eyaml_writer_fd(int fd, struct eyamlwriteropts const* opts);
+
+/** Open a mapping */
+int eyaml_writer_begin_map(struct eyamlwriter* self);
+
+/** Open a sequence */
+int eyaml_writer_begin_seq(struct eyamlwriter* self);
+
+/** Write the name of the next member of the innermost mapping
+  * @param [in] name A null-terminated string */
+int eyaml_writer_key(struct eyamlwriter* self, char const* name);
+
+/** Write a scalar in a sequence or as the value of a key
+  * It is written plain if it can be, else it is quoted.
+  * @param [in] value A null-terminated string */
+int eyaml_writer_scalar(struct eyamlwriter* self, char const* value);
+
+/** Close the innermost collection */
+int eyaml_writer_end(struct eyamlwriter* self);
+
+/** Send to the sink the text written so far
+  * The last few events may be kept until the next ones are known. */
+int eyaml_writer_flush(struct eyamlwriter* self);
+
+/** End the stream, flush it and destroy the writer
+  * Every collection must be closed.
+  * @return Zero if the whole stream was written, non-zero on error */
+int eyaml_writer_close(struct eyamlwriter* self);
+
 /** Print in stdout debug info */
 void eyaml_debug(struct eyaml* self);
 
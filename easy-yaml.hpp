@@ -0,0 +1,365 @@
+#ifndef EASY_YAML_HPP
+#define EASY_YAML_HPP
+
+#include "easy-yaml.h"
+#include <charconv>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/** @defgroup easyyamlcpp Easy YAML for C++.
+  * Header-only C++17 wrapper of the easy-yaml API. Every member is an
+  * inline forward to the C functions: nodes are plain handles, strings
+  * are views over the stored scalars with their stored lengths and paths
+  * are parsed at compile time into a fixed list of steps.
+  * @{ */
+
+namespace easyyaml {
+
+/** Type of data that the easy-yaml nodes can hold */
+enum class type {
+    scalar = EYAML_SCALAR,
+    mapping = EYAML_MAPPING,
+    sequence = EYAML_SEQUENCE
+};
+
+/** Conversion of a scalar value into a C++ type. Specialize it to add types.
+  * A specialization has a static member 'bool from(std::string_view, T&)'
+  * that returns false if the value can not be converted. */
+template<class T, class Enable = void>
+struct convert;
+
+template<>
+struct convert<std::string_view> {
+    static bool from(std::string_view str, std::string_view& dest) {
+        dest = str;
+        return true;
+    }
+};
+
+template<>
+struct convert<std::string> {
+    static bool from(std::string_view str, std::string& dest) {
+        dest.assign(str.data(), str.size());
+        return true;
+    }
+};
+
+/* Booleans of the YAML 1.2 core schema */
+template<>
+struct convert<bool> {
+    static bool from(std::string_view str, bool& dest) {
+        if (str == "true" || str == "True" || str == "TRUE")
+            dest = true;
+        else if (str == "false" || str == "False" || str == "FALSE")
+            dest = false;
+        else
+            return false;
+        return true;
+    }
+};
+
+/* Integers of the YAML 1.2 core schema: decimal, 0o octal and 0x hexadecimal */
+template<class T>
+struct convert<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+    static bool from(std::string_view str, T& dest) {
+        char const* begin = str.data();
+        char const* const end = begin + str.size();
+        int base = 10;
+        if (end - begin > 2 && '0' == begin[0] && ('x' == begin[1] || 'o' == begin[1])) {
+            base = 'x' == begin[1] ? 16 : 8;
+            begin += 2;
+            if ('-' == *begin)
+                return false;
+        }
+        else if (end - begin > 1 && '+' == begin[0] && '-' != begin[1])
+            ++begin;
+        auto const [ptr, ec] = std::from_chars(begin, end, dest, base);
+        return std::errc() == ec && end == ptr;
+    }
+};
+
+/* Floats of the YAML 1.2 core schema, including .inf and .nan */
+template<class T>
+struct convert<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static bool from(std::string_view str, T& dest) {
+        if (str == ".nan" || str == ".NaN" || str == ".NAN") {
+            dest = std::numeric_limits<T>::quiet_NaN();
+            return true;
+        }
+        bool const plus = !str.empty() && '+' == str[0];
+        if (plus)
+            str.remove_prefix(1);
+        bool const minus = !plus && !str.empty() && '-' == str[0];
+        std::string_view const abs = minus ? str.substr(1) : str;
+        if (abs == ".inf" || abs == ".Inf" || abs == ".INF") {
+            dest = minus ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+            return true;
+        }
+        if (abs.empty() || ('.' != abs[0] && (abs[0] < '0' || '9' < abs[0])))
+            return false;
+        char const* const end = str.data() + str.size();
+        auto const [ptr, ec] = std::from_chars(str.data(), end, dest);
+        return std::errc() == ec && end == ptr;
+    }
+};
+
+/** Path to a descendant node, such as "servers[2].name".
+  * Names are separated by dots and indexes go between brackets. The text
+  * is parsed when the path is constructed, so a constexpr path of a string
+  * literal holds a fixed list of name and index steps and an ill-formed
+  * path is a compile-time error. Names can not contain '.' or '['. */
+template<std::size_t N>
+struct path {
+
+    /** A step is a name if 'name' is non-negative, else an index */
+    struct step {
+        int name = -1;  /**< Offset of the null-terminated name in 'names' */
+        int index = 0;  /**< Index of the child when it is not a name      */
+    };
+
+    /** Parse a path literal
+      * @param [in] str A string literal with the path */
+    constexpr path(char const (&str)[N]) {
+        std::size_t i = 0;
+        while(i < N - 1) {
+            if ('[' == str[i]) {
+                std::size_t j = i + 1;
+                int index = 0;
+                for(; j < N - 1 && ']' != str[j]; ++j) {
+                    if (str[j] < '0' || '9' < str[j])
+                        throw "easyyaml::path: an index must be a decimal number";
+                    index = index * 10 + (str[j] - '0');
+                }
+                if (j == N - 1 || j == i + 1)
+                    throw "easyyaml::path: unterminated or empty index";
+                steps[count].index = index;
+                ++count;
+                i = j + 1;
+                if (i < N - 1 && '.' == str[i] && ++i == N - 1)
+                    throw "easyyaml::path: a path can not end with a dot";
+            }
+            else {
+                std::size_t j = i;
+                for(; j < N - 1 && '.' != str[j] && '[' != str[j]; ++j) {
+                    if (']' == str[j])
+                        throw "easyyaml::path: unbalanced bracket";
+                    names[j] = str[j];
+                }
+                if (j == i)
+                    throw "easyyaml::path: empty name";
+                steps[count].name = static_cast<int>(i);
+                ++count;
+                i = j;
+                if (i < N - 1 && '.' == str[i] && ++i == N - 1)
+                    throw "easyyaml::path: a path can not end with a dot";
+            }
+        }
+    }
+
+    char names[N] = {};  /**< The names of the steps, each one null-terminated */
+    step steps[N] = {};  /**< The steps, from the first to the last one        */
+    int count = 0;       /**< The number of steps                              */
+};
+
+/** Non-owning handle of a easy-yaml node. It is as cheap as the pointer.
+  * Every accessor accepts a null node and returns an empty result. */
+class node {
+public:
+
+    /** Iterator over the children of a sequence or mapping node */
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = node const*;
+        using reference = node;
+
+        constexpr iterator(struct eyaml* handle = nullptr) noexcept : current(handle) { }
+        node operator*() const noexcept { return node(current); }
+        iterator& operator++() { current = eyaml_sibling(current); return *this; }
+        iterator operator++(int) { iterator prev = *this; ++*this; return prev; }
+        bool operator==(iterator const& other) const noexcept { return current == other.current; }
+        bool operator!=(iterator const& other) const noexcept { return current != other.current; }
+
+    private:
+        struct eyaml* current;
+    };
+
+    constexpr node(struct eyaml* handle = nullptr) noexcept : self(handle) { }
+
+    /** Get the C handle, null if the node does not exist */
+    struct eyaml* handle() const noexcept { return self; }
+
+    /** Check whether the node exists */
+    explicit operator bool() const noexcept { return nullptr != self; }
+
+    /** Get the type of the node. The node must exist */
+    easyyaml::type type() const { return static_cast<easyyaml::type>(eyaml_type(self)); }
+
+    /** Get the name of a mapping child, empty if it is not a mapping child */
+    std::string_view name() const {
+        char const* const str = self ? eyaml_name(self) : nullptr;
+        return str ? std::string_view(str, eyaml_namelen(self)) : std::string_view();
+    }
+
+    /** Get the value of a scalar node, empty if it is not a scalar */
+    std::string_view value() const {
+        char const* const str = eyaml_value(self);
+        return str ? std::string_view(str, eyaml_length(self)) : std::string_view();
+    }
+
+    /** Check whether the node exists and is a scalar */
+    bool isscalar() const { return nullptr != eyaml_value(self); }
+
+    /** Get the number of children, or the length of the value of a scalar */
+    std::size_t size() const { return self ? eyaml_length(self) : 0; }
+
+    /** Get a child of a mapping by its name, null node if it is not found */
+    node operator[](char const* name) const { return eyaml_name2child(self, name); }
+
+    /** Get a child of a mapping or sequence by its index, null node if it is not found */
+    node operator[](int index) const { return eyaml_index2child(self, index); }
+
+    /** Follow a path of names and indexes, null node if any step fails */
+    template<std::size_t N>
+    node operator[](path<N> const& p) const {
+        struct eyaml* current = self;
+        for(int i = 0; i < p.count; ++i)
+            current = walk(current, p, p.steps[i]);
+        return current;
+    }
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    /** Follow a path literal, e.g. node.at<"servers[2].name">(). The path is
+      * expanded at compile time into one call per step. Requires C++20. */
+    template<path P>
+    node at() const {
+        return unroll<P>(std::make_index_sequence<P.count>());
+    }
+#endif
+
+    /** Get the value of a scalar node converted to T
+      * @return The value, or nothing if the node is not a scalar or the conversion fails */
+    template<class T>
+    std::optional<T> get() const {
+        char const* const str = eyaml_value(self);
+        if (nullptr == str)
+            return std::nullopt;
+        T dest{};
+        if (!convert<T>::from(std::string_view(str, eyaml_length(self)), dest))
+            return std::nullopt;
+        return dest;
+    }
+
+    /** Get the value of a scalar node converted to T, or a default value */
+    template<class T>
+    T get(T fallback) const { return get<T>().value_or(std::move(fallback)); }
+
+    iterator begin() const { return iterator(eyaml_child(self)); }
+    iterator end() const noexcept { return iterator(); }
+
+    bool operator==(node const& other) const noexcept { return self == other.self; }
+    bool operator!=(node const& other) const noexcept { return self != other.self; }
+
+private:
+
+    template<std::size_t N>
+    static struct eyaml* walk(struct eyaml* current, path<N> const& p, typename path<N>::step const& s) {
+        return s.name < 0 ? eyaml_index2child(current, s.index) : eyaml_name2child(current, p.names + s.name);
+    }
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    template<path P, std::size_t... I>
+    node unroll(std::index_sequence<I...>) const {
+        struct eyaml* current = self;
+        ((current = P.steps[I].name < 0
+            ? eyaml_index2child(current, P.steps[I].index)
+            : eyaml_name2child(current, P.names + P.steps[I].name)), ...);
+        return current;
+    }
+#endif
+
+    struct eyaml* self;
+};
+
+/** Owner of a easy-yaml tree. Destroys the tree when it goes out of scope */
+class document {
+public:
+
+    document() noexcept = default;
+
+    /** Take the ownership of a tree
+      * @param [in] root The root handle returned by a parse function */
+    explicit document(struct eyaml* root) noexcept : self(root) { }
+
+    document(document const&) = delete;
+    document& operator=(document const&) = delete;
+
+    document(document&& other) noexcept : self(other.release()) { }
+
+    document& operator=(document&& other) noexcept {
+        if (this != &other)
+            reset(other.release());
+        return *this;
+    }
+
+    ~document() { reset(); }
+
+    /** Parse a YAML stream, replacing the current tree
+      * @param [in] src  Source stream
+      * @param [in] opts Limits of the parse, may be null
+      * @return Zero on success, the error code of eyaml_parse_opts() else */
+    int parse(FILE* src, struct eyamlopts const* opts = nullptr) {
+        struct eyaml* root = nullptr;
+        int const err = eyaml_parse_opts(&root, src, opts);
+        reset(root);
+        return err;
+    }
+
+    /** Parse a YAML or JSON text, replacing the current tree
+      * @param [in] str  The text, it does not need to be null-terminated
+      * @param [in] opts Limits of the parse, may be null
+      * @return Zero on success, the error code of eyaml_parse_string_opts() else */
+    int parse(std::string_view str, struct eyamlopts const* opts = nullptr) {
+        struct eyaml* root = nullptr;
+        int const err = eyaml_parse_string_opts(&root, str.data(), str.size(), opts);
+        reset(root);
+        return err;
+    }
+
+    /** Get the root node, the stream whose children are the documents */
+    easyyaml::node root() const noexcept { return self; }
+
+    /** Get a document of the stream by its index */
+    easyyaml::node operator[](int index) const { return eyaml_index2child(self, index); }
+
+    /** Check whether the document holds a tree */
+    explicit operator bool() const noexcept { return nullptr != self; }
+
+    /** Give up the ownership of the tree
+      * @return The root handle, the caller must destroy it */
+    struct eyaml* release() noexcept { return std::exchange(self, nullptr); }
+
+    /** Destroy the current tree and take the ownership of other one */
+    void reset(struct eyaml* root = nullptr) noexcept {
+        if (self)
+            eyaml_destroy(self);
+        self = root;
+    }
+
+private:
+    struct eyaml* self = nullptr;
+};
+
+} /* namespace easyyaml */
+
+/** @} */
+
+#endif /* EASY_YAML_HPP */
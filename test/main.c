@@ -1,7 +1,1101 @@
 
 #include "easy-yaml.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <zlib.h>
+#ifdef EYAML_ZSTD
+#include <zstd.h>
+#endif
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/lsan_interface.h>
+#endif
+
+/* Check that two trees have the same shape, names and values */
+static int sametree(struct eyaml* a, struct eyaml* b) {
+    for(; a && b; a = eyaml_sibling(a), b = eyaml_sibling(b)) {
+        if (eyaml_type(a) != eyaml_type(b) || eyaml_length(a) != eyaml_length(b))
+            return 0;
+        char const* na = eyaml_name(a);
+        char const* nb = eyaml_name(b);
+        if ((NULL == na) != (NULL == nb) || (na && strcmp(na, nb)))
+            return 0;
+        if (eyaml_namelen(a) != eyaml_namelen(b))
+            return 0;
+        char const* va = eyaml_value(a);
+        char const* vb = eyaml_value(b);
+        if ((NULL == va) != (NULL == vb) || (va && strcmp(va, vb)))
+            return 0;
+        if (EYAML_SCALAR != eyaml_type(a) && !sametree(eyaml_child(a), eyaml_child(b)))
+            return 0;
+    }
+    return a == b;
+}
+
+/* Emit a tree into a new allocated string */
+static char* emit2str(struct eyaml* root) {
+    char* buff;
+    size_t size;
+    FILE* strm = open_memstream(&buff, &size);
+    assert(strm);
+    eyaml_emit(root, strm);
+    fclose(strm);
+    return buff;
+}
+
+/* Parse a string with LIBYAML */
+static int libyaml(struct eyaml** root, char const* str) {
+    FILE* strm = fmemopen((void*)str, strlen(str), "r");
+    assert(strm);
+    int err = eyaml_parse(root, strm);
+    fclose(strm);
+    return err;
+}
+
+/* Signature of the in-memory parsers */
+typedef int (*parser_t)(struct eyaml**, char const*, size_t);
+
+/* Check that an in-memory parser and LIBYAML build the same tree */
+static void differential(char const* str, parser_t parser, int supported) {
+    struct eyaml* expected = NULL;
+    int err = libyaml(&expected, str);
+    assert(0 == err);
+    struct eyaml* root = NULL;
+    err = parser(&root, str, strlen(str));
+    assert(supported ? 0 == err : EYAML_UNSUPPORTED == err);
+    if (!supported) {
+        assert(NULL == root);
+        err = eyaml_parse_string(&root, str, strlen(str));
+        assert(0 == err);
+    }
+    assert(sametree(expected, root));
+    char* a = emit2str(expected);
+    char* b = emit2str(root);
+    assert(0 == strcmp(a, b));
+    free(a);
+    free(b);
+    eyaml_destroy(expected);
+    eyaml_destroy(root);
+}
+
+static void test_native(void) {
+    static char const* const natives[] = {
+        "",
+        "# only a comment\n",
+        "a: 1\n",
+        "---\n  name: perry\n  data:\n    age: 12\n    color: black\n"
+        "    results: [blue, yellow, red]\n  scores: [1, 2, 3]\n",
+        "a: 1\nb:\n  c: x y z   \n  d: 'it''s'\n  e: \"q\"\nf: [ ]\n",
+        "servers:\n- name: alpha\n  port: 80\n- name: beta\n  port: 81\nend: 1\n",
+        "list:\n  - a\n  -\n  - [x, 'y', \"z\"]\n  -\n    - nested\n",
+        "a:   # comment\n# another\n\n  b: c # trailing\n...\n---\nx: url://host:80/p?q#f\n",
+        "-\n  k: v\n- a: \n    b: c\n  d: e\n",
+        "empty:\nnull: ~\n'quoted key': v\n\"other\" : w\n",
+        "a: 1\n---\nb: 2",
+    };
+    static char const* const fallbacks[] = {
+        "a: &x 1\n",
+        "a: !!str 1\n",
+        "? complex\n: key\n",
+        "a: |\n  literal\n  text\n",
+        "a: >\n  folded\n  text\n",
+        "a: multi\n  line\n",
+        "a: {b: c}\n",
+        "a: \"esc\\tape\"\n",
+        "a: \"two\n  lines\"\n",
+        "a:\tb\n",
+        "%YAML 1.1\n---\na: 1\n",
+        "a: [b, c,]\n",
+        "- - a\n",
+    };
+    for(int i = 0; i < sizeof natives / sizeof *natives; ++i)
+        differential(natives[i], eyaml_parse_native, 1);
+    for(int i = 0; i < sizeof fallbacks / sizeof *fallbacks; ++i)
+        differential(fallbacks[i], eyaml_parse_native, 0);
+    puts("native scanner: ok");
+}
+
+/* Convert a YAML text to JSON */
+static char* yaml2json(char const* str) {
+    struct eyaml* root = NULL;
+    int err = eyaml_parse_string(&root, str, strlen(str));
+    assert(0 == err);
+    char* buff;
+    size_t size;
+    FILE* strm = open_memstream(&buff, &size);
+    assert(strm);
+    err = eyaml_emit_json(root, strm);
+    assert(0 == err);
+    fclose(strm);
+    eyaml_destroy(root);
+    return buff;
+}
+
+/* A tree to be written as JSON in another thread */
+struct emitjob {
+    struct eyaml* root;
+    char* json;
+    size_t size;
+    int err;
+};
+
+static void* emitjson(void* arg) {
+    struct emitjob* job = arg;
+    FILE* strm = open_memstream(&job->json, &job->size);
+    assert(strm);
+    job->err = eyaml_emit_json(job->root, strm);
+    fclose(strm);
+    return NULL;
+}
+
+static void test_json(void) {
+    static char const* const supported[] = {
+        "{}",
+        "[]",
+        "\n  {\"a\":1, \"b\" : [true, false, null], \"c\": {\"d\": -0.5e+3}}\n",
+        "[\"\", \"x y\", \"esc \\\" \\\\ \\/ \\b\\f\\n\\r\\t \\u00e9\\u20ac\", \"\xc3\xb1\"]",
+        "[[1, [2, [3]]], {\"k\": []}, 0, 10, 1.25, 2E-2]",
+        "{\"list\":\n  [\n    {\"name\": \"alpha\", \"port\": 80},\n    {\"name\": \"beta\", \"port\": 81}\n  ]\n}\n",
+    };
+    static char const* const unsupported[] = {
+        "{\"a\": 1,}",
+        "[01]",
+        "[1.]",
+        "{\"a\"\n: 1}",
+        "{a: 1}",
+        "[\"\\uD83D\\uDE00\"]",
+        "[plain]",
+        "{\"a\": 1}\n---\n{\"b\": 2}\n",
+    };
+    for(int i = 0; i < sizeof supported / sizeof *supported; ++i)
+        differential(supported[i], eyaml_parse_json, 1);
+    for(int i = 0; i < sizeof unsupported / sizeof *unsupported; ++i) {
+        struct eyaml* root = NULL;
+        int err = eyaml_parse_json(&root, unsupported[i], strlen(unsupported[i]));
+        assert(EYAML_UNSUPPORTED == err || 0 > err);
+        assert(NULL == root);
+    }
+
+    /* Documents of a stream are written one per line, that is not a YAML stream */
+    static struct { char const* yaml; char const* json; int single; } const emits[] = {
+        { "a: 1\nb: [x, 'true', true, ~, -2.5]\nc:\n  d: \"q\\\"\"\n",
+          "{\"a\":1,\"b\":[\"x\",\"true\",true,null,-2.5],\"c\":{\"d\":\"q\\\"\"}}\n", 1 },
+        { "- 0x1F\n- 1_000\n- TRUE\n- \"tab\\t\\x01\"\n",
+          "[\"0x1F\",\"1_000\",true,\"tab\\t\\u0001\"]\n", 1 },
+        { "a: 1\n---\n[]\n", "{\"a\":1}\n[]\n", 0 },
+    };
+    for(int i = 0; i < sizeof emits / sizeof *emits; ++i) {
+        char* json = yaml2json(emits[i].yaml);
+        assert(0 == strcmp(json, emits[i].json));
+        if (emits[i].single) {
+            char* again = yaml2json(json);
+            assert(0 == strcmp(json, again));
+            free(again);
+        }
+        free(json);
+    }
+
+    /* Deep nesting is written without recursion, even in a small stack */
+    int const depth = 10000;
+    char* deep = malloc(2 * depth + 2);
+    assert(deep);
+    memset(deep, '[', depth);
+    deep[depth] = '1';
+    memset(deep + depth + 1, ']', depth);
+    deep[2 * depth + 1] = '\0';
+    struct emitjob job = { .root = NULL };
+    int err = eyaml_parse_string(&job.root, deep, 2 * depth + 1);
+    assert(0 == err);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    pthread_t thread;
+    err = pthread_create(&thread, &attr, emitjson, &job);
+    assert(0 == err);
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    assert(0 == job.err);
+    assert(job.size == 2 * depth + 2);
+    assert(0 == memcmp(job.json, deep, 2 * depth + 1));
+    free(job.json);
+    free(deep);
+    eyaml_destroy(job.root);
+    puts("json: ok");
+}
+
+/* Parse a text from a stream and from memory within some limits and
+   check that all the ways give the expected result */
+static void limited(char const* str, struct eyamlopts const* opts, int expected) {
+    struct eyaml* root = NULL;
+    FILE* strm = fmemopen((void*)str, strlen(str), "r");
+    assert(strm);
+    int err = eyaml_parse_opts(&root, strm, opts);
+    fclose(strm);
+    assert(expected == err);
+    assert(err ? NULL == root : NULL != root);
+    eyaml_destroy(root);
+    err = eyaml_parse_string_opts(&root, str, strlen(str), opts);
+    assert(expected == err);
+    assert(err ? NULL == root : NULL != root);
+    eyaml_destroy(root);
+}
+
+static void test_limits(void) {
+    /* Native, JSON and LIBYAML inputs of the same tree: 7 nodes, depth 2 */
+    static char const* const texts[] = {
+        "a: 1\nlist: [x, yy]\n",
+        "{\"a\": 1, \"list\": [\"x\", \"yy\"]}",
+        "a: 1\nlist: [x, !!str yy]\n",
+    };
+    for(int i = 0; i < sizeof texts / sizeof *texts; ++i) {
+        char const* str = texts[i];
+        size_t const len = strlen(str);
+        limited(str, NULL, 0);
+        limited(str, &(struct eyamlopts){ .maxbytes = len }, 0);
+        limited(str, &(struct eyamlopts){ .maxbytes = len - 1 }, EYAML_EBYTES);
+        limited(str, &(struct eyamlopts){ .maxnodes = 7 }, 0);
+        limited(str, &(struct eyamlopts){ .maxnodes = 6 }, EYAML_ENODES);
+        limited(str, &(struct eyamlopts){ .maxdepth = 2 }, 0);
+        limited(str, &(struct eyamlopts){ .maxdepth = 1 }, EYAML_EDEPTH);
+        limited(str, &(struct eyamlopts){ .maxscalar = 4 }, 0);
+        limited(str, &(struct eyamlopts){ .maxscalar = 3 }, EYAML_ESCALAR);
+        limited(str, &(struct eyamlopts){ .maxdocs = 1 }, 0);
+    }
+    char const* docs = "a: 1\n---\nb: 2\n---\nc: 3\n";
+    limited(docs, &(struct eyamlopts){ .maxdocs = 3 }, 0);
+    limited(docs, &(struct eyamlopts){ .maxdocs = 2 }, EYAML_EDOCS);
+
+    /* A deep input is stopped at the limit, not at the end */
+    static char deep[20001];
+    memset(deep, '[', sizeof deep - 1);
+    limited(deep, &(struct eyamlopts){ .maxdepth = 100 }, EYAML_EDEPTH);
+    puts("limits: ok");
+}
+
+/* Feed a push parser with the first bytes of a text and then with the rest
+   in chunks. Check that it fails or builds the same tree as eyaml_parse() */
+static void pushed(char const* str, size_t first, size_t chunk) {
+    struct eyaml* expected = NULL;
+    int const experr = libyaml(&expected, str);
+    struct eyamlpush* parser = eyaml_push_create(NULL);
+    assert(parser);
+    size_t const len = strlen(str);
+    int ready = 0;
+    int err = EYAML_NEEDMORE;
+    for(size_t i = 0; i < len && 0 <= err; ) {
+        size_t n = 0 == i && 0 < first ? first : chunk;
+        if (len - i < n)
+            n = len - i;
+        err = eyaml_feed(parser, str + i, n);
+        assert(0 > err || EYAML_NEEDMORE == err || EYAML_DOCREADY == err);
+        if (EYAML_DOCREADY == err) {
+            int const docs = eyaml_length(eyaml_push_root(parser));
+            assert(docs > ready);
+            ready = docs;
+        }
+        i += n;
+    }
+    struct eyaml* root = NULL;
+    if (0 <= err)
+        err = eyaml_finish(parser, &root);
+    eyaml_push_destroy(parser);
+    if (experr) {
+        assert(err < 0);
+        assert(NULL == root);
+        return;
+    }
+    assert(0 == err);
+    assert(eyaml_length(root) >= ready);
+    assert(sametree(expected, root));
+    char* a = emit2str(expected);
+    char* b = emit2str(root);
+    assert(0 == strcmp(a, b));
+    free(a);
+    free(b);
+    eyaml_destroy(expected);
+    eyaml_destroy(root);
+}
+
+static void test_push(void) {
+    /* Valid and invalid texts, each one fed in two parts split at every
+       byte, and also byte by byte and in chunks of a few bytes */
+    static char const* const texts[] = {
+        "",
+        "a: 1\n",
+        "a: 1\nb:\n  - x\n  - y\n---\nc: |\n  text\n  ---x\n...\n# end\n",
+        "%YAML 1.1\n---\na: [1, 2]\n...\n%YAML 1.1\n---\n{b: \"q\"}\n--- [3]\n",
+        "---\na: >\n  folded\n---\n- last",
+        "a: 1\n...\n\n...\n---\nb: 2\n",
+        "a: 1\nb:\n  c: [x, 'y']\n  d: !t 2\n---\n- e\n- f: 3\n",
+        "a: 1\n...\n# caf\xc3\xa9\n...\n--- [1]\n---\nb: 2\n",
+        "a: 1\n...\n  # indented\n---\nb: 2\n...\n...",
+        "# only a comment\n",
+        "---\n...\n...\n",
+        "--- &a [x]\n--- {k: *a}\n",
+        "a: \"two\n  lines\"\n---\nb: 'x'\r\n",
+        "{\"a\": 1}\n---\n[\"b\"]\n",
+        "a: |\n  %not a directive\n  # nor a comment\n",
+        "- - a\n  - b\n---\n? k\n: v\n",
+        /* After a '...' only a '---' or a directive may start a document */
+        "...\n",
+        "# c\n...\n",
+        "a: 1\n...\nb: 2\n",
+        "a: 1\n...\nb: 2",
+        "a: 1\n...\n%YAML 1.1\nb: 2\n",
+        "%YAML 1.1\n...\n",
+        /* Markers, directives and line ends in odd places */
+        "a: \"x\n---\n y\"\n",
+        "a: 'x\n...\n'\n",
+        "--- |\n  x\n---\n",
+        "a: |\n  x\n...\n",
+        "--- >\n x\n\n...\n",
+        "%TAG !e! tag:e,2000:\n---\n!e!x a\n",
+        "\xef\xbb\xbf" "a: 1\n",
+        "a: 1\r\n...\r\n---\r\nb: 2\r\n",
+        "a:\n- 1\n...\n",
+        "---a\n",
+        "--- # c\na\n",
+        "... # c\n",
+        "a\n... # c\n---\nb\n",
+        "%YAML 1.1\n%YAML 1.1\n---\na\n",
+        "a\n...\n%FOO x\n---\nb\n",
+        "a\n---\n",
+        "a\n...\n---\n...\n",
+        /* Other errors */
+        "a: 1\n---\nb: [\n---\n",
+        "a: [1\n",
+        "a: 1\n b: 2\n",
+    };
+    for(int i = 0; i < sizeof texts / sizeof *texts; ++i) {
+        size_t const len = strlen(texts[i]);
+        for(size_t first = 0; first <= len; ++first)
+            pushed(texts[i], first, len);
+        for(size_t chunk = 1; chunk < 16; chunk += 3)
+            pushed(texts[i], 0, chunk);
+    }
+
+    /* Errors stop the parser and the tree built so far is released */
+    struct eyamlpush* parser = eyaml_push_create(&(struct eyamlopts){ .maxdocs = 1 });
+    assert(parser);
+    char const* str = "a: 1\n---\nb: 2\n---\n";
+    int err = eyaml_feed(parser, str, strlen(str));
+    assert(EYAML_EDOCS == err);
+    err = eyaml_feed(parser, "c: 3\n", 5);
+    assert(EYAML_EDOCS == err);
+    eyaml_push_destroy(parser);
+
+    parser = eyaml_push_create(NULL);
+    assert(parser);
+    str = "a: 1\n---\nb: [\n---\n";
+    err = eyaml_feed(parser, str, strlen(str));
+    assert(err < 0);
+    assert(1 == eyaml_length(eyaml_push_root(parser)));
+    eyaml_push_destroy(parser);
+
+    /* A document in the native subset is scanned as its lines arrive, so
+       a limit stops the parser long before the document is complete */
+    parser = eyaml_push_create(&(struct eyamlopts){ .maxnodes = 100 });
+    assert(parser);
+    int lines = 0;
+    do {
+        char line[32];
+        int const len = sprintf(line, "key%d: %d\n", lines, lines);
+        err = eyaml_feed(parser, line, len);
+        ++lines;
+    } while (EYAML_NEEDMORE == err && lines < 1000);
+    assert(EYAML_ENODES == err);
+    assert(lines < 100);
+    eyaml_push_destroy(parser);
+
+    /* Many lines in small chunks */
+    char* buff;
+    size_t size;
+    FILE* strm = open_memstream(&buff, &size);
+    assert(strm);
+    for(int i = 0; i < 2000; ++i)
+        fprintf(strm, "- id: %d\n  tags: [a, \"b\"]\n%s", i, 999 == i ? "---\n" : "");
+    fclose(strm);
+    pushed(buff, 0, 100);
+    pushed(buff, 0, 4093);
+    free(buff);
+    puts("push parser: ok");
+}
+
+static void test_index(void) {
+    char const* str =
+        "servers:\n"
+        "- name: alpha\n  zone: eu\n"
+        "- name: beta\n  zone: us\n"
+        "- port: 80\n"
+        "- plain\n"
+        "- name: [not, scalar]\n"
+        "- name: gamma\n  zone: eu\n"
+        "- zone: eu\n  name: ''\n";
+    struct eyaml* root = NULL;
+    int err = eyaml_parse_string(&root, str, strlen(str));
+    assert(0 == err);
+    struct eyaml* servers = eyaml_name2child(eyaml_child(root), "servers");
+    assert(servers);
+
+    struct eyamlindex* byname = eyaml_build_index(servers, "name");
+    assert(byname);
+    assert(eyaml_index_isunique(byname));
+    assert(eyaml_index_find(byname, "beta") == eyaml_index2child(servers, 1));
+    assert(eyaml_index_find(byname, "gamma") == eyaml_index2child(servers, 5));
+    assert(eyaml_index_find(byname, "") == eyaml_index2child(servers, 6));
+    assert(NULL == eyaml_index_find(byname, "delta"));
+    assert(NULL == eyaml_index_find(byname, "alph"));
+
+    struct eyamlindex* byzone = eyaml_build_index(servers, "zone");
+    assert(byzone);
+    assert(!eyaml_index_isunique(byzone));
+    struct eyaml* found[2];
+    int num = eyaml_index_findall(byzone, "eu", found, 2);
+    assert(3 == num);
+    assert(found[0] == eyaml_index2child(servers, 0));
+    assert(found[1] == eyaml_index2child(servers, 5));
+    assert(1 == eyaml_index_findall(byzone, "us", found, 2));
+    assert(0 == eyaml_index_findall(byzone, "asia", found, 2));
+    assert(0 == strcmp("beta", eyaml_name2value(found[0], "name")));
+
+    /* A failed build gives a null index */
+    assert(NULL == eyaml_index_find(NULL, "beta"));
+    assert(0 == eyaml_index_findall(NULL, "eu", found, 2));
+    assert(!eyaml_index_isunique(NULL));
+
+    eyaml_index_free(byname);
+    eyaml_index_free(byzone);
+    eyaml_destroy(root);
+
+    /* Many elements */
+    char* buff;
+    size_t size;
+    FILE* strm = open_memstream(&buff, &size);
+    assert(strm);
+    for(int i = 0; i < 5000; ++i)
+        fprintf(strm, "- id: %d\n  group: g%d\n", i, i % 7);
+    fclose(strm);
+    err = eyaml_parse_string(&root, buff, size);
+    assert(0 == err);
+    free(buff);
+    struct eyaml* seq = eyaml_child(root);
+    struct eyamlindex* byid = eyaml_build_index(seq, "id");
+    struct eyamlindex* bygroup = eyaml_build_index(seq, "group");
+    assert(byid && bygroup);
+    assert(eyaml_index_isunique(byid));
+    for(int i = 0; i < 5000; i += 499) {
+        char id[16];
+        sprintf(id, "%d", i);
+        struct eyaml* node = eyaml_index_find(byid, id);
+        assert(node);
+        assert(0 == strcmp(id, eyaml_name2value(node, "id")));
+    }
+    assert(715 == eyaml_index_findall(bygroup, "g0", NULL, 0));
+    assert(714 == eyaml_index_findall(bygroup, "g6", NULL, 0));
+    eyaml_index_free(byid);
+    eyaml_index_free(bygroup);
+    eyaml_destroy(root);
+    puts("index: ok");
+}
+
+/* Compress a buffer with gzip into a new allocated buffer */
+static unsigned char* gzip(char const* str, size_t len, size_t* size) {
+    z_stream z;
+    memset(&z, 0, sizeof z);
+    int err = deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    assert(Z_OK == err);
+    *size = deflateBound(&z, len);
+    unsigned char* buff = malloc(*size);
+    assert(buff);
+    z.next_in = (unsigned char*)str;
+    z.avail_in = len;
+    z.next_out = buff;
+    z.avail_out = *size;
+    err = deflate(&z, Z_FINISH);
+    assert(Z_STREAM_END == err);
+    *size = z.total_out;
+    deflateEnd(&z);
+    return buff;
+}
+
+#ifdef EYAML_ZSTD
+/* Compress a buffer with zstd into a new allocated buffer */
+static unsigned char* zstd(char const* str, size_t len, size_t* size) {
+    *size = ZSTD_compressBound(len);
+    unsigned char* buff = malloc(*size);
+    assert(buff);
+    *size = ZSTD_compress(buff, *size, str, len, 3);
+    assert(!ZSTD_isError(*size));
+    return buff;
+}
+#endif
+
+/* Signature of the compressors of the tests */
+typedef unsigned char* (*compressor_t)(char const*, size_t, size_t*);
+
+/* Parse a buffer with eyaml_parse_compressed() */
+static int compressed(struct eyaml** root, void const* buff, size_t size, int flags, struct eyamlopts const* opts) {
+    FILE* strm = fmemopen((void*)buff, size, "r");
+    assert(strm);
+    int err = eyaml_parse_compressed(root, strm, flags, opts);
+    fclose(strm);
+    return err;
+}
+
+static void test_compressed(void) {
+    char* text;
+    size_t len;
+    FILE* strm = open_memstream(&text, &len);
+    assert(strm);
+    for(int i = 0; i < 20000; ++i)
+        fprintf(strm, "- id: %d\n  name: \"item %d\"\n  tags: [a, b]\n", i, i);
+    fclose(strm);
+    struct eyaml* expected = NULL;
+    int err = libyaml(&expected, text);
+    assert(0 == err);
+
+    /* The codecs compiled in, gzip always in the tests */
+    static compressor_t const compressors[] = {
+        gzip,
+#ifdef EYAML_ZSTD
+        zstd,
+#endif
+    };
+    for(int c = 0; c < sizeof compressors / sizeof *compressors; ++c) {
+        compressor_t const compress = compressors[c];
+        size_t size;
+        unsigned char* gz = compress(text, len, &size);
+        assert(size < len);
+        for(int flags = 0; flags <= EYAML_THREADED; flags += EYAML_THREADED) {
+            struct eyaml* root = NULL;
+            err = compressed(&root, text, len, flags, NULL);
+            assert(0 == err);
+            assert(sametree(expected, root));
+            eyaml_destroy(root);
+
+            err = compressed(&root, gz, size, flags, NULL);
+            assert(0 == err);
+            assert(sametree(expected, root));
+            eyaml_destroy(root);
+
+            /* The byte limit applies to the decoded bytes */
+            err = compressed(&root, gz, size, flags, &(struct eyamlopts){ .maxbytes = len / 2 });
+            assert(EYAML_EBYTES == err);
+            assert(NULL == root);
+            err = compressed(&root, gz, size, flags, &(struct eyamlopts){ .maxbytes = len });
+            assert(0 == err);
+            eyaml_destroy(root);
+
+            /* A truncated input fails */
+            err = compressed(&root, gz, size - 16, flags, NULL);
+            assert(0 != err);
+            assert(NULL == root);
+
+            /* A cut in the end of the last member or frame fails even if
+               the decoded prefix is valid YAML */
+            static char const small[] = "a: 1\nb: 2\n";
+            size_t smallsize;
+            unsigned char* smallgz = compress(small, sizeof small - 1, &smallsize);
+            for(int cut = 1; cut <= 10; ++cut) {
+                err = compressed(&root, smallgz, smallsize - cut, flags, NULL);
+                assert(0 != err);
+                assert(NULL == root);
+            }
+            err = compressed(&root, smallgz, smallsize, flags, NULL);
+            assert(0 == err);
+            eyaml_destroy(root);
+            free(smallgz);
+
+            /* A parse error stops the decoder thread */
+            static char const bad[] = "a: [b\nc: d\n";
+            size_t badsize;
+            unsigned char* badgz = compress(bad, sizeof bad - 1, &badsize);
+            err = compressed(&root, badgz, badsize, flags, NULL);
+            assert(0 != err && EYAML_UNSUPPORTED != err);
+            free(badgz);
+        }
+        free(gz);
+
+        /* Several gzip members or zstd frames are concatenated */
+        size_t size1, size2;
+        unsigned char* gz1 = compress("a: 1\n", 5, &size1);
+        unsigned char* gz2 = compress("b: 2\n", 5, &size2);
+        unsigned char* both = malloc(size1 + size2);
+        assert(both);
+        memcpy(both, gz1, size1);
+        memcpy(both + size1, gz2, size2);
+        struct eyaml* root = NULL;
+        err = compressed(&root, both, size1 + size2, 0, NULL);
+        assert(0 == err);
+        struct eyaml* doc = eyaml_child(root);
+        assert(0 == strcmp("1", eyaml_name2value(doc, "a")));
+        assert(0 == strcmp("2", eyaml_name2value(doc, "b")));
+        eyaml_destroy(root);
+        free(gz1);
+        free(gz2);
+        free(both);
+    }
+    eyaml_destroy(expected);
+    free(text);
+
+#ifndef EYAML_ZSTD
+    static unsigned char const frame[] = { 0x28, 0xb5, 0x2f, 0xfd, 0x00, 0x00 };
+    struct eyaml* root = NULL;
+    err = compressed(&root, frame, sizeof frame, 0, NULL);
+    assert(EYAML_UNSUPPORTED == err);
+#endif
+    puts("compressed: ok");
+}
+
+/* Check that the nodes of a tree are laid out in depth-first order */
+static int isdfs(struct eyaml* node, char const** prev) {
+    if ((char const*)node <= *prev)
+        return 0;
+    *prev = (char const*)node;
+    for(struct eyaml* i = eyaml_child(node); NULL != i; i = eyaml_sibling(i))
+        if (EYAML_SCALAR != eyaml_type(node) && !isdfs(i, prev))
+            return 0;
+    return 1;
+}
+
+static void test_extract(void) {
+    char const* str =
+        "%YAML 1.1\n%TAG !e! tag:example.com,2000:\n---\n"
+        "name: perry\n"
+        "data: &d\n"
+        "  age: !e!int 12\n"
+        "  results: [blue, 'yellow', \"r\\0d\"]\n"
+        "  more:\n    - {a: 1}\n    - ~\n"
+        "end: 1\n";
+    struct eyaml* root = NULL;
+    int err = libyaml(&root, str);
+    assert(0 == err);
+    struct eyaml* stream = eyaml_extract(root);
+    assert(stream);
+    char const* prev = NULL;
+    assert(isdfs(stream, &prev));
+    assert(sametree(root, stream));
+    char* a = emit2str(root);
+    char* b = emit2str(stream);
+    assert(0 == strcmp(a, b));
+    free(a);
+    free(b);
+
+    struct eyaml* data = eyaml_name2child(eyaml_child(root), "data");
+    struct eyaml* copy = eyaml_extract(data);
+    assert(copy);
+    assert(NULL == eyaml_sibling(copy));
+    prev = NULL;
+    assert(isdfs(copy, &prev));
+    struct eyaml* expected = NULL;
+    err = libyaml(&expected, str);
+    assert(0 == err);
+    eyaml_destroy(root);
+    eyaml_destroy(stream);
+
+    assert(0 == strcmp("data", eyaml_name(copy)));
+    assert(EYAML_MAPPING == eyaml_type(copy));
+    assert(0 == strcmp("12", eyaml_name2value(copy, "age")));
+    struct eyaml* results = eyaml_name2child(copy, "results");
+    assert(3 == eyaml_length(results));
+    assert(3 == eyaml_length(eyaml_index2child(results, 2)));
+    data = eyaml_name2child(eyaml_child(expected), "data");
+    assert(sametree(eyaml_child(data), eyaml_child(copy)));
+    eyaml_destroy(expected);
+    eyaml_destroy(copy);
+    puts("extract: ok");
+}
+
+/* Sink of a writer that appends the text to a stream */
+static int streamsink(void* data, char const* buff, size_t len) {
+    return len == fwrite(buff, 1, len, data) ? 0 : -1;
+}
+
+/* Write the nodes of the writer test, returning the first error */
+static int writedocs(struct eyamlwriter* w) {
+    int err = eyaml_writer_begin_map(w);
+    err |= eyaml_writer_key(w, "name");
+    err |= eyaml_writer_scalar(w, "a: b");
+    err |= eyaml_writer_key(w, "empty");
+    err |= eyaml_writer_scalar(w, "");
+    err |= eyaml_writer_key(w, "multi");
+    err |= eyaml_writer_scalar(w, "l1\nl2 # caf\xc3\xa9");
+    err |= eyaml_writer_key(w, "- key");
+    err |= eyaml_writer_begin_seq(w);
+    err |= eyaml_writer_scalar(w, "x");
+    err |= eyaml_writer_scalar(w, "y, z");
+    err |= eyaml_writer_end(w);
+    err |= eyaml_writer_key(w, "long");
+    err |= eyaml_writer_begin_seq(w);
+    for(char const* i = "1234"; *i; ++i) {
+        char const item[] = { *i, '\0' };
+        err |= eyaml_writer_scalar(w, item);
+    }
+    err |= eyaml_writer_end(w);
+    err |= eyaml_writer_key(w, "list");
+    err |= eyaml_writer_begin_seq(w);
+    err |= eyaml_writer_scalar(w, "[a]");
+    err |= eyaml_writer_begin_map(w);
+    err |= eyaml_writer_key(w, "k");
+    err |= eyaml_writer_scalar(w, "v");
+    err |= eyaml_writer_end(w);
+    err |= eyaml_writer_begin_seq(w);
+    err |= eyaml_writer_end(w);
+    err |= eyaml_writer_end(w);
+    err |= eyaml_writer_end(w);
+    err |= eyaml_writer_begin_seq(w);
+    err |= eyaml_writer_scalar(w, "second");
+    err |= eyaml_writer_end(w);
+    return err;
+}
+
+static void test_writer(void) {
+    char const* expected =
+        "name: 'a: b'\n"
+        "empty: ''\n"
+        "multi: \"l1\\nl2 # caf\xc3\xa9\"\n"
+        "'- key': [x, 'y, z']\n"
+        "long: [1, 2, 3, 4]\n"
+        "list:\n  - '[a]'\n  - k: v\n  - []\n"
+        "---\n"
+        "- second\n";
+    char* text;
+    size_t len;
+    FILE* strm = open_memstream(&text, &len);
+    assert(strm);
+    struct eyamlwriteropts const opts = { .flowseq = 3 };
+    struct eyamlwriter* w = eyaml_writer_create(streamsink, strm, &opts);
+    assert(w);
+    int err = writedocs(w);
+    assert(0 == err);
+    err = eyaml_writer_close(w);
+    assert(0 == err);
+    fclose(strm);
+    assert(strstr(text, "[x, 'y, z']"));
+    assert(NULL == strstr(text, "[1, 2"));
+    struct eyaml* root = NULL;
+    err = libyaml(&root, text);
+    assert(0 == err);
+    struct eyaml* tree = NULL;
+    err = libyaml(&tree, expected);
+    assert(0 == err);
+    assert(sametree(tree, root));
+    eyaml_destroy(root);
+    eyaml_destroy(tree);
+    free(text);
+
+    /* A misplaced call fails and so does every later call */
+    strm = open_memstream(&text, &len);
+    assert(strm);
+    w = eyaml_writer_create(streamsink, strm, NULL);
+    assert(w);
+    err = eyaml_writer_scalar(w, "top");
+    assert(0 != err);
+    err = eyaml_writer_begin_map(w);
+    assert(0 != err);
+    err = eyaml_writer_close(w);
+    assert(0 != err);
+    fclose(strm);
+    free(text);
+    strm = open_memstream(&text, &len);
+    w = eyaml_writer_create(streamsink, strm, NULL);
+    err = eyaml_writer_begin_seq(w);
+    assert(0 == err);
+    err = eyaml_writer_key(w, "k");
+    assert(0 != err);
+    err = eyaml_writer_close(w);
+    assert(0 != err);
+    fclose(strm);
+    free(text);
+
+    /* A null string fails instead of reaching LIBYAML */
+    strm = open_memstream(&text, &len);
+    w = eyaml_writer_create(streamsink, strm, NULL);
+    err = eyaml_writer_begin_map(w);
+    assert(0 == err);
+    err = eyaml_writer_key(w, NULL);
+    assert(0 != err);
+    err = eyaml_writer_key(w, "k");
+    assert(0 != err);
+    err = eyaml_writer_close(w);
+    assert(0 != err);
+    fclose(strm);
+    free(text);
+    strm = open_memstream(&text, &len);
+    w = eyaml_writer_create(streamsink, strm, NULL);
+    err = eyaml_writer_begin_seq(w);
+    assert(0 == err);
+    err = eyaml_writer_scalar(w, "a");
+    assert(0 == err);
+    err = eyaml_writer_scalar(w, NULL);
+    assert(0 != err);
+    err = eyaml_writer_end(w);
+    assert(0 != err);
+    err = eyaml_writer_close(w);
+    assert(0 != err);
+    fclose(strm);
+    free(text);
+
+    /* Small batches to a file descriptor */
+    strm = tmpfile();
+    assert(strm);
+    struct eyamlwriteropts const small = { .buffsize = 16, .flowseq = 8 };
+    w = eyaml_writer_fd(fileno(strm), &small);
+    assert(w);
+    err = eyaml_writer_begin_seq(w);
+    for(int i = 0; i < 1000; ++i) {
+        char item[16];
+        snprintf(item, sizeof item, "item %d", i);
+        err |= eyaml_writer_scalar(w, item);
+        if (0 == i % 100)
+            err |= eyaml_writer_flush(w);
+    }
+    err |= eyaml_writer_end(w);
+    assert(0 == err);
+    err = eyaml_writer_close(w);
+    assert(0 == err);
+    rewind(strm);
+    err = eyaml_parse(&root, strm);
+    assert(0 == err);
+    fclose(strm);
+    struct eyaml* seq = eyaml_child(root);
+    assert(1000 == eyaml_length(seq));
+    assert(0 == strcmp("item 999", eyaml_index2value(seq, 999)));
+    eyaml_destroy(root);
+    puts("writer: ok");
+}
+
+/* Parse the trees of the destroy test with every parser */
+static void parseall(struct eyaml* trees[5], char const* tagged, char const* plain, char const* json) {
+    int err = libyaml(trees, tagged);
+    assert(0 == err);
+    err = eyaml_parse_native(trees + 1, plain, strlen(plain));
+    assert(0 == err);
+    err = eyaml_parse_json(trees + 2, json, strlen(json));
+    assert(0 == err);
+    trees[3] = eyaml_extract(eyaml_name2child(eyaml_child(trees[0]), "list"));
+    assert(trees[3]);
+    struct eyamlpush* push = eyaml_push_create(NULL);
+    assert(push);
+    err = eyaml_feed(push, tagged, strlen(tagged));
+    assert(0 <= err);
+    err = eyaml_finish(push, trees + 4);
+    assert(0 == err);
+    eyaml_push_destroy(push);
+}
+
+/* Build a long stream, with tags and directives or without them */
+static char* makestream(int tagged) {
+    char* buff;
+    size_t len;
+    FILE* strm = open_memstream(&buff, &len);
+    assert(strm);
+    fputs(tagged ? "%TAG !e! tag:example.com,2000:\n---\nlist:\n" : "list:\n", strm);
+    for(int i = 0; i < 20000; ++i)
+        fprintf(strm, "  - id: %d\n    name: %s'user %d'\n    tags: [a, \"b\"]\n", i, tagged ? "!e!str " : "", i);
+    fputs("---\nsecond: doc\n", strm);
+    fclose(strm);
+    return buff;
+}
+
+static void test_destroy(void) {
+    char* tagged = makestream(1);
+    char* plain = makestream(0);
+    char const* json = "{\"a\": [1, \"two\", {\"b\": null}], \"c\": \"caf\\u00e9\"}";
+
+    /* Free rounds of trees with the reclaimer and without it. Built with
+       ASan, LeakSanitizer checks that every node and event was freed */
+    for(int round = 0; round < 4; ++round) {
+        struct eyaml* trees[5];
+        parseall(trees, tagged, plain, json);
+        for(int i = 0; i < 5; ++i)
+            eyaml_destroy(trees[i]);
+        parseall(trees, tagged, plain, json);
+        for(int i = 0; i < 5; ++i)
+            eyaml_destroy_async(trees[i]);
+        eyaml_destroy_async(NULL);
+        eyaml_destroy_drain();
+    }
+#ifdef __SANITIZE_ADDRESS__
+    int const leaks = __lsan_do_recoverable_leak_check();
+    assert(0 == leaks);
+#endif
+    free(tagged);
+    free(plain);
+    puts("destroy: ok");
+}
+
+/* Check that every document of an index parses as in the whole file */
+static void samedocs(char const* path, struct eyamldocindex const* index) {
+    FILE* file = fopen(path, "r");
+    assert(file);
+    struct eyaml* whole = NULL;
+    int err = eyaml_parse(&whole, file);
+    assert(0 == err);
+    fclose(file);
+    int const count = eyaml_docindex_count(index);
+    assert(eyaml_length(whole) == count);
+    for(int n = 0; n < count; ++n) {
+        struct eyaml* root = NULL;
+        err = eyaml_parse_document(&root, path, index, n - (n % 2 ? count : 0));
+        assert(0 == err);
+        assert(1 == eyaml_length(root));
+        assert(sametree(eyaml_child(eyaml_index2child(whole, n)), eyaml_child(eyaml_child(root))));
+        eyaml_destroy(root);
+    }
+    eyaml_destroy(whole);
+}
+
+static void test_docindex(void) {
+    char const* str =
+        "# header\n"
+        "a: 1\n"
+        "---\nb: [1, 2]\n# comment\n"
+        "--- {c: 3}\n"
+        "...\n# between\n%YAML 1.1\n---\nd: |\n  text\n  --- not a marker\n"
+        "...\n...\n  # indented\n--- \ne: after two ends\n"
+        "---\n- f\n- g\n---\n"
+        "h: last";
+    char path[] = "/tmp/eyamlXXXXXX";
+    int fd = mkstemp(path);
+    assert(0 <= fd);
+    close(fd);
+    char saved[sizeof path + 4];
+    snprintf(saved, sizeof saved, "%s.idx", path);
+
+    FILE* file = fopen(path, "w");
+    assert(file);
+    fputs(str, file);
+    fclose(file);
+    struct eyamldocindex* index = eyaml_index_documents(path);
+    assert(index);
+    assert(7 == eyaml_docindex_count(index));
+    samedocs(path, index);
+    struct eyaml* root = NULL;
+    int err = eyaml_parse_document(&root, path, index, 7);
+    assert(0 != err);
+    err = eyaml_parse_document(&root, path, index, -8);
+    assert(0 != err);
+    eyaml_docindex_free(index);
+
+    /* Append the text in small pieces, updating an index that is saved
+       and loaded on the way, and compare it with a new one each time */
+    file = fopen(path, "w");
+    assert(file);
+    fclose(file);
+    index = eyaml_index_documents(path);
+    assert(index);
+    assert(0 == eyaml_docindex_count(index));
+    size_t const len = strlen(str);
+    for(size_t i = 0; i < len; i += 7) {
+        file = fopen(path, "a");
+        assert(file);
+        fwrite(str + i, 1, len - i < 7 ? len - i : 7, file);
+        fclose(file);
+        if (i % 3 == 0) {
+            err = eyaml_docindex_save(index, saved);
+            assert(0 == err);
+            eyaml_docindex_free(index);
+            index = eyaml_docindex_load(saved);
+            assert(index);
+        }
+        err = eyaml_docindex_update(index, path);
+        assert(0 == err);
+        struct eyamldocindex* fresh = eyaml_index_documents(path);
+        assert(fresh);
+        assert(eyaml_docindex_count(fresh) == eyaml_docindex_count(index));
+        eyaml_docindex_free(fresh);
+    }
+    samedocs(path, index);
+
+    /* A file that eyaml_parse() rejects for a misplaced marker is not
+       indexed, nor updated once a line feed ends the misplaced line */
+    static char const* const invalid[] = {
+        "...\n",
+        "a: 1\n...\nb: 2\n",
+        "%YAML 1.1\nb: 2\n",
+    };
+    for(int i = 0; i < sizeof invalid / sizeof *invalid; ++i) {
+        file = fopen(path, "w");
+        assert(file);
+        fputs(invalid[i], file);
+        fclose(file);
+        struct eyamldocindex* bad = eyaml_index_documents(path);
+        assert(NULL == bad);
+    }
+    file = fopen(path, "w");
+    assert(file);
+    fputs("a: 1\n...\nb", file);
+    fclose(file);
+    struct eyamldocindex* growing = eyaml_index_documents(path);
+    assert(growing);
+    assert(1 == eyaml_docindex_count(growing));
+    file = fopen(path, "a");
+    assert(file);
+    fputs(": 2\n", file);
+    fclose(file);
+    err = eyaml_docindex_update(growing, path);
+    assert(0 != err);
+    eyaml_docindex_free(growing);
+
+    /* A truncated file can not be updated */
+    file = fopen(path, "w");
+    assert(file);
+    fputs("a: 1\n", file);
+    fclose(file);
+    err = eyaml_docindex_update(index, path);
+    assert(0 != err);
+    eyaml_docindex_free(index);
+    index = eyaml_docindex_load(path);
+    assert(NULL == index);
+    remove(saved);
+    remove(path);
+    puts("docindex: ok");
+}
+
+static void test_parser(void) {
+    static char const* const messages[] = {
+        "{\"id\": 1, \"tags\": [\"a\", \"b\"]}",
+        "id: 2\nname: native\nitems:\n  - x\n  - y\n",
+        "%TAG !e! tag:example.com,2000:\n---\nid: !e!int 3\nname: 'quoted'\n",
+        "id: 4\nbad: [unclosed\n",
+        "--- !!map\n? complex\n: key\n...\n%YAML 1.1\n---\n- !!str 5\n",
+        "a: {b: [c, {d: e}]}\n"
+    };
+    int const count = sizeof messages / sizeof *messages;
+    struct eyamlparser* parser = eyaml_parser_create(NULL);
+    assert(parser);
+    for(int round = 0; round < 3; ++round) {
+        for(int i = 0; i < count; ++i) {
+            size_t const len = strlen(messages[i]);
+            struct eyaml* expected = NULL;
+            int err = eyaml_parse_string(&expected, messages[i], len);
+            struct eyaml* root = NULL;
+            int const err2 = eyaml_parser_parse(parser, &root, messages[i], len);
+            assert(err == err2);
+            assert(sametree(expected, root));
+            eyaml_destroy(expected);
+        }
+        eyaml_parser_reset(parser);
+    }
+    eyaml_parser_destroy(parser);
+
+    struct eyamlopts const opts = { .maxdepth = 2 };
+    parser = eyaml_parser_create(&opts);
+    assert(parser);
+    struct eyaml* root = NULL;
+    int err = eyaml_parser_parse(parser, &root, "a: {b: [c]}\n", 12);
+    assert(EYAML_EDEPTH == err);
+    assert(NULL == root);
+    err = eyaml_parser_parse(parser, &root, "a: {b: c}\n", 10);
+    assert(0 == err);
+    assert(0 == strcmp("c", eyaml_name2value(eyaml_name2child(eyaml_child(root), "a"), "b")));
+    eyaml_parser_destroy(parser);
+    puts("parser: ok");
+}
 
 int main(int argc, char** argv) {
     puts("\n\tPARSER\n");
@@ -64,5 +1158,38 @@ int main(int argc, char** argv) {
     eyaml_emit(root, stdout);
 
     eyaml_destroy(root);
+
+    puts("\n\tNATIVE\n");
+    test_native();
+
+    puts("\n\tJSON\n");
+    test_json();
+
+    puts("\n\tLIMITS\n");
+    test_limits();
+
+    puts("\n\tPUSH\n");
+    test_push();
+
+    puts("\n\tINDEX\n");
+    test_index();
+
+    puts("\n\tCOMPRESSED\n");
+    test_compressed();
+
+    puts("\n\tEXTRACT\n");
+    test_extract();
+
+    puts("\n\tWRITER\n");
+    test_writer();
+
+    puts("\n\tDESTROY\n");
+    test_destroy();
+
+    puts("\n\tDOCINDEX\n");
+    test_docindex();
+
+    puts("\n\tPARSER CONTEXT\n");
+    test_parser();
     return 0;
 }
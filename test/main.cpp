@@ -0,0 +1,232 @@
+
+#include "easy-yaml.hpp"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std::literals;
+
+/* Check if the parse of a path throws */
+template<std::size_t N>
+static bool badpath(char const (&str)[N]) {
+    try {
+        easyyaml::path<N> p(str);
+        (void)p;
+    }
+    catch (char const*) {
+        return true;
+    }
+    return false;
+}
+
+static void test_path(void) {
+    constexpr easyyaml::path p("servers[12].name");
+    static_assert(3 == p.count);
+    static_assert(0 == p.steps[0].name && 12 == p.steps[1].index && p.steps[1].name < 0);
+    assert(0 == strcmp("servers", p.names + p.steps[0].name));
+    assert(0 == strcmp("name", p.names + p.steps[2].name));
+
+    constexpr easyyaml::path q("[0][1]");
+    static_assert(2 == q.count && 0 == q.steps[0].index && 1 == q.steps[1].index);
+
+    assert(badpath("a..b"));
+    assert(badpath("a."));
+    assert(badpath("a["));
+    assert(badpath("a[]"));
+    assert(badpath("a[x]"));
+    assert(badpath("a]b"));
+    assert(badpath("[1]."));
+    assert(!badpath("a.b[3].c"));
+    puts("path: ok");
+}
+
+/* Convert a string and compare the result */
+template<class T>
+static bool converts(char const* str, T expected) {
+    T dest{};
+    return easyyaml::convert<T>::from(str, dest) && dest == expected;
+}
+
+/* Check that a string can not be converted */
+template<class T>
+static bool fails(char const* str) {
+    T dest{};
+    return !easyyaml::convert<T>::from(str, dest);
+}
+
+static void test_convert(void) {
+    assert(converts<int>("42", 42));
+    assert(converts<int>("-3", -3));
+    assert(converts<int>("+7", 7));
+    assert(converts<int>("0x1F", 31));
+    assert(converts<int>("0o17", 15));
+    assert(converts<long>("0x7fffffff", 0x7fffffffL));
+    assert(fails<int>("+-1"));
+    assert(fails<int>("0x-1"));
+    assert(fails<int>("0o-7"));
+    assert(fails<int>("0x"));
+    assert(fails<int>("0o8"));
+    assert(fails<int>("1_000"));
+    assert(fails<int>("12 "));
+    assert(fails<int>(""));
+
+    /* Overflows */
+    assert(converts<std::int8_t>("127", 127));
+    assert(fails<std::int8_t>("128"));
+    assert(converts<std::uint8_t>("0xff", 255));
+    assert(fails<std::uint8_t>("0x100"));
+    assert(fails<std::uint8_t>("-1"));
+    assert(fails<int>("99999999999"));
+
+    assert(converts<bool>("true", true));
+    assert(converts<bool>("False", false));
+    assert(converts<bool>("TRUE", true));
+    assert(fails<bool>("yes"));
+    assert(fails<bool>("1"));
+
+    assert(converts<double>("1.5", 1.5));
+    assert(converts<double>(".5", 0.5));
+    assert(converts<double>("-2e3", -2000.0));
+    assert(converts<double>("+1", 1.0));
+    assert(converts<double>(".inf", INFINITY));
+    assert(converts<double>("-.Inf", -INFINITY));
+    double nan = 0;
+    bool const converted = easyyaml::convert<double>::from(".nan", nan);
+    assert(converted && std::isnan(nan));
+    assert(fails<double>("+.nan"));
+    assert(fails<double>("+-1"));
+    assert(fails<double>("inf"));
+    assert(fails<double>("1.5x"));
+    assert(fails<double>(""));
+
+    assert(converts<std::string>("text", "text"s));
+    assert(converts<std::string_view>("text", "text"sv));
+    puts("convert: ok");
+}
+
+static char const text[] =
+    "name: demo\n"
+    "port: 0x1F90\n"
+    "debug: true\n"
+    "ratio: .25\n"
+    "servers:\n"
+    "  - name: alpha\n"
+    "    zone: eu\n"
+    "  - name: beta\n"
+    "    zone: us\n"
+    "tags: [a, 'b c', \"d\"]\n";
+
+static void test_node(void) {
+    easyyaml::document doc;
+    assert(!doc);
+    int err = doc.parse(std::string_view(text, sizeof text - 1));
+    assert(0 == err);
+    assert(doc);
+    easyyaml::node const root = doc[0];
+    assert(easyyaml::type::mapping == root.type());
+    assert(6 == root.size());
+
+    assert("demo"sv == root["name"].value());
+    assert("name"sv == root["name"].name());
+    assert(8080 == root["port"].get<int>());
+    assert(true == root["debug"].get<bool>());
+    assert(0.25 == root["ratio"].get<double>(0));
+    assert(!root["name"].get<int>());
+    assert(7 == root["name"].get(7));
+    assert(!root["servers"].get<std::string>());
+    assert(root["servers"].value().empty());
+
+    /* Null nodes give empty results */
+    easyyaml::node const none = root["missing"];
+    assert(!none);
+    assert(!none["a"] && !none[0]);
+    assert(none.name().empty() && none.value().empty() && 0 == none.size());
+    assert(!none.get<int>());
+    assert(none.begin() == none.end());
+    assert(!root["servers"][2]);
+    assert(!root["servers"][-1]);
+
+    /* Paths */
+    assert("beta"sv == root[easyyaml::path("servers[1].name")].value());
+    assert("b c"sv == root[easyyaml::path("tags[1]")].value());
+    assert(!root[easyyaml::path("servers[5].name")]);
+    assert(!root[easyyaml::path("name.sub")]);
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    assert("us"sv == root.at<"servers[1].zone">().value());
+    assert(root.at<"servers[0]">() == root["servers"][0]);
+    assert(!root.at<"servers[0].port">());
+    puts("at: ok");
+#endif
+
+    /* Iteration */
+    std::string names;
+    for(easyyaml::node const child : root)
+        names.append(child.name()).append(" ");
+    assert("name port debug ratio servers tags "s == names);
+    std::string tags;
+    for(easyyaml::node const tag : root["tags"])
+        tags.append(tag.value()).append("|");
+    assert("a|b c|d|"s == tags);
+    assert(2 == std::distance(root["servers"].begin(), root["servers"].end()));
+    int zones = 0;
+    for(easyyaml::node const server : root["servers"])
+        zones += "eu"sv == server["zone"].value() || "us"sv == server["zone"].value();
+    assert(2 == zones);
+    puts("node: ok");
+}
+
+static void test_document(void) {
+    static_assert(!std::is_copy_constructible_v<easyyaml::document>);
+    static_assert(!std::is_copy_assignable_v<easyyaml::document>);
+    static_assert(std::is_nothrow_move_constructible_v<easyyaml::document>);
+    static_assert(std::is_nothrow_move_assignable_v<easyyaml::document>);
+
+    easyyaml::document a;
+    int err = a.parse("a: 1\n"sv);
+    assert(0 == err);
+    struct eyaml* const handle = a.root().handle();
+    easyyaml::document b(std::move(a));
+    assert(!a && b);
+    assert(handle == b.root().handle());
+
+    easyyaml::document c;
+    err = c.parse("c: 3\n"sv);
+    assert(0 == err);
+    c = std::move(b);
+    assert(!b && handle == c.root().handle());
+    assert(1 == c[0]["a"].get<int>());
+
+    struct eyaml* const released = c.release();
+    assert(!c && handle == released);
+    c.reset(released);
+    assert(c);
+
+    /* A failed parse leaves the document empty */
+    err = c.parse("a: [b\n"sv);
+    assert(0 != err);
+    assert(!c);
+
+    FILE* file = tmpfile();
+    assert(file);
+    fputs(text, file);
+    rewind(file);
+    err = c.parse(file);
+    assert(0 == err);
+    fclose(file);
+    assert("alpha"sv == c[0][easyyaml::path("servers[0].name")].value());
+    puts("document: ok");
+}
+
+int main(int argc, char** argv) {
+    printf("\n\tC++%ld WRAPPER\n\n", __cplusplus / 100 % 100);
+    test_path();
+    test_convert();
+    test_node();
+    test_document();
+    return 0;
+}